@@ -1,8 +1,15 @@
 #ifndef DEVICES_PIT_H
 #define DEVICES_PIT_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+/* PIT cycles per second. */
+#define PIT_HZ 1193180
+
 void pit_configure_channel (int channel, int mode, int frequency);
+void pit_start_one_shot (int channel, unsigned count);
+unsigned pit_read_counter (int channel);
+bool pit_output_high (int channel);
 
 #endif /* devices/pit.h */
@@ -4,7 +4,10 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/heap-profile.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
@@ -123,6 +126,11 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  malloc_print_stats ();
+  palloc_print_stats ();
+#ifdef HEAP_PROFILE
+  heap_profile_print ();
+#endif
 #ifdef FILESYS
   block_print_stats ();
 #endif
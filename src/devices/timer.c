@@ -7,7 +7,6 @@
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
-#include "threads/malloc.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -21,6 +20,29 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* PIT cycles per timer tick. */
+#define TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest one-shot the 16-bit PIT counter can time, in ticks. */
+#define ONE_SHOT_MAX_TICKS (0xffff / TICK_COUNT)
+
+/* If false (default), the timer interrupts TIMER_FREQ times per
+   second at all times.
+   If true, the idle thread stops the periodic interrupt while
+   the CPU is halted and uses a one-shot interrupt instead.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* Ticks covered by the one-shot interrupt currently programmed by
+   timer_idle_enter(), or 0 if the timer is periodic. */
+static int64_t one_shot_ticks;
+
+/* Number of timer interrupts avoided by tickless idle. */
+static int64_t tickless_saved;
+
+/* Longest time spent in timer_interrupt(), in CPU cycles. */
+static uint64_t max_interrupt_cycles;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
@@ -30,18 +52,17 @@ static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
-/*A holder for all waiting events*/
-static struct list all_events_list;
 
-/* Custom data structure to hold the threads to be put into the ready list
-after the desired ticks have elapsed */
-struct event
-{
-  int64_t wake_up_time;
-  struct thread *event_thread;
-  struct semaphore sema_event; //used to block and unblock the thread
-  struct list_elem event_elem;
-};
+/* Sleeping threads, ordered by wake-up tick.  This is a pairing
+   heap threaded through the sleep_child and sleep_sibling members
+   of struct thread, so putting a thread to sleep allocates no
+   memory.  SLEEP_QUEUE is the root, the thread that wakes first,
+   or a null pointer if no thread is sleeping. */
+static struct thread *sleep_queue;
+
+static void sleep_queue_insert (struct thread *);
+static struct thread *sleep_queue_pop (void);
+static void wake_sleepers (int64_t now);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -50,7 +71,7 @@ timer_init (void)
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-  list_init (&all_events_list);
+  sleep_queue = NULL;
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -104,48 +125,19 @@ void
 timer_sleep (int64_t ticks)
 {
   int64_t start = timer_ticks ();
-  //initialize the event struct
-  struct event *event_from_thread = malloc(sizeof(struct event));
-
-  ASSERT (intr_get_level () == INTR_ON);
-  struct thread *cur_thread = thread_current ();
-  //calculating the wake up time based on the ticks passed
-  event_from_thread->wake_up_time = start + ticks;
-  sema_init (&event_from_thread->sema_event, 0); //initialize the event semaphore
-  event_from_thread->event_thread = cur_thread;
-  int inserted = 0;
-  struct list_elem *each_event;
-
-  // copied from synch.c
-  // Disabling interrupt here since the list will be shared between kernel thread and interrupt handler
+  struct thread *cur = thread_current ();
   enum intr_level old_level;
-  ASSERT (!intr_context ());
-  old_level = intr_disable ();
 
-  //populating the events list based on the individual wake up times
-  //this helps in keeping the list sorted as per the wake up times of the events
-  //referred line 37 of list.h
-  for (each_event = list_begin (&all_events_list); each_event != list_end (&all_events_list);
-       each_event = list_next (each_event))
-    {
-      //check for the appropriate position by comparing the wake up time of each element.
-      struct event *event_data = list_entry (each_event, struct event, event_elem);
-      if (event_from_thread->wake_up_time <= event_data->wake_up_time) {
-        list_insert (each_event, &event_from_thread->event_elem);
-        inserted  = 1;
-        break;
-      }
-    }
-    //if the new event was not inserted in the list then push it in the end
-    //as it has the highest wake up time or the events list is empty.
-  if (!inserted) {
-	  list_push_back (&all_events_list, &event_from_thread->event_elem);
-  }
+  ASSERT (intr_get_level () == INTR_ON);
+  if (ticks <= 0)
+    return;
 
-  // Re-enable the interrupt
+  // Disabling interrupt here since the queue is shared between kernel threads and the interrupt handler
+  old_level = intr_disable ();
+  cur->wake_tick = start + ticks;
+  sleep_queue_insert (cur);
+  thread_block ();
   intr_set_level (old_level);
-
-  sema_down (&event_from_thread->sema_event);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -211,54 +203,224 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Returns the CPU's time-stamp counter, for measuring short
+   intervals in cycles. */
+uint64_t
+timer_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Returns the largest number of CPU cycles spent in a single
+   timer interrupt so far. */
+uint64_t
+timer_max_interrupt_cycles (void)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t t = max_interrupt_cycles;
+  intr_set_level (old_level);
+  return t;
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void)
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" ticks, %"PRIu64" cycles max per interrupt\n",
+          timer_ticks (), timer_max_interrupt_cycles ());
 }
 
-/* Helper method used by timer interrupt to suspend the threads based on the elapsed ticks*/
+/* Combines pairing heaps A and B, either of which may be null,
+   and returns the root of the result.  The root with the later
+   wake-up tick becomes the leftmost child of the other. */
+static struct thread *
+sleep_queue_meld (struct thread *a, struct thread *b)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (b->wake_tick < a->wake_tick)
+    {
+      struct thread *tmp = a;
+      a = b;
+      b = tmp;
+    }
+  b->sleep_sibling = a->sleep_child;
+  a->sleep_child = b;
+  return a;
+}
+
+/* Adds T, whose wake_tick is set, to the sleep queue.  O(1). */
 static void
-execute_event (int64_t elapsed_ticks)
+sleep_queue_insert (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->sleep_child = t->sleep_sibling = NULL;
+  sleep_queue = sleep_queue_meld (sleep_queue, t);
+}
+
+/* Removes and returns the thread that wakes first, which must
+   exist.  Its children are merged back together with the usual
+   two passes, done iteratively to spare the kernel stack:
+   first meld them in pairs from left to right, then meld the
+   pairs into one heap from right to left.  O(log n) amortized. */
+static struct thread *
+sleep_queue_pop (void)
 {
-  //if the list isn't empty then we have to find the threads which need to be suspended
-  while (!list_empty(&all_events_list)) {
-    struct list_elem *head_elem = list_begin(&all_events_list);
-    struct event *head_element = list_entry (head_elem, struct event, event_elem);
-    if (head_element->wake_up_time <= elapsed_ticks) {
-      list_pop_front(&all_events_list);
-      sema_up(&head_element->sema_event);
-      //free(head_element); TODO
-    } else {
-      break;
+  struct thread *min = sleep_queue;
+  struct thread *child = min->sleep_child;
+  struct thread *pairs = NULL;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (child != NULL)
+    {
+      struct thread *a = child;
+      struct thread *b = a->sleep_sibling;
+      struct thread *pair;
+
+      child = b != NULL ? b->sleep_sibling : NULL;
+      a->sleep_sibling = NULL;
+      if (b != NULL)
+        b->sleep_sibling = NULL;
+      pair = sleep_queue_meld (a, b);
+      pair->sleep_sibling = pairs;
+      pairs = pair;
+    }
+
+  sleep_queue = NULL;
+  while (pairs != NULL)
+    {
+      struct thread *next = pairs->sleep_sibling;
+      pairs->sleep_sibling = NULL;
+      sleep_queue = sleep_queue_meld (pairs, sleep_queue);
+      pairs = next;
     }
-  }
+
+  min->sleep_child = NULL;
+  return min;
+}
+
+/* Wakes up, in one batch, every sleeping thread whose wake-up
+   tick is NOW or earlier. */
+static void
+wake_sleepers (int64_t now)
+{
+  while (sleep_queue != NULL && sleep_queue->wake_tick <= now)
+    thread_unblock (sleep_queue_pop ());
+}
+
+/* Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  In tickless mode, replaces the periodic
+   timer interrupt by a single one-shot interrupt at the next
+   sleeper's wake-up tick, or as far ahead as the PIT can count,
+   whichever comes first.
+
+   Tickless idle is not used with the MLFQS, which must sample
+   the ready threads at exact tick boundaries. */
+void
+timer_idle_enter (void)
+{
+  int64_t n = ONE_SHOT_MAX_TICKS;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || thread_mlfqs || one_shot_ticks != 0)
+    return;
+
+  if (sleep_queue != NULL && sleep_queue->wake_tick - ticks < n)
+    n = sleep_queue->wake_tick - ticks;
+  if (n < 2)
+    return;
+
+  one_shot_ticks = n;
+  pit_start_one_shot (0, n * TICK_COUNT);
+}
+
+/* Called by the idle thread, with interrupts off, when it stops
+   idling.  If a one-shot interrupt is still counting down, that
+   is, something other than the timer woke the CPU, then credits
+   the whole ticks that have passed since timer_idle_enter(),
+   wakes any sleepers they made due, and returns the timer to
+   periodic mode.  The partial tick in progress is lost.  Also
+   called by timer_interrupt() for a periodic interrupt that
+   arrives while the one-shot is still counting down. */
+void
+timer_idle_exit (void)
+{
+  int64_t elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (one_shot_ticks == 0)
+    return;
+
+  /* If the countdown has already expired, its interrupt is
+     pending and timer_interrupt() will do the accounting. */
+  if (pit_output_high (0))
+    return;
+
+  elapsed = (one_shot_ticks * TICK_COUNT - pit_read_counter (0)) / TICK_COUNT;
+  pit_configure_channel (0, 2, TIMER_FREQ);
+  one_shot_ticks = 0;
+
+  ticks += elapsed;
+  thread_tick_idle (elapsed);
+  tickless_saved += elapsed;
+  wake_sleepers (ticks);
+}
+
+/* Returns the number of timer interrupts avoided by tickless
+   idle so far. */
+int64_t
+timer_tickless_saved (void)
+{
+  enum intr_level old_level = intr_disable ();
+  int64_t t = tickless_saved;
+  intr_set_level (old_level);
+  return t;
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  uint64_t start = timer_cycles ();
+  uint64_t elapsed;
+
+  /* The one-shot interrupt programmed by timer_idle_enter()
+     stands for several ticks, all but the last spent idle.  But
+     if the countdown is still running, this is a periodic
+     interrupt that was already pending when the idle thread
+     reprogrammed the timer: count it as an ordinary tick, after
+     crediting only the time that has actually passed. */
+  if (one_shot_ticks != 0)
+    {
+      if (pit_output_high (0))
+        {
+          pit_configure_channel (0, 2, TIMER_FREQ);
+          ticks += one_shot_ticks - 1;
+          thread_tick_idle (one_shot_ticks - 1);
+          tickless_saved += one_shot_ticks - 1;
+          one_shot_ticks = 0;
+        }
+      else
+        timer_idle_exit ();
+    }
+
   ticks++;
   thread_tick ();
+  thread_mlfqs_tick (ticks);
 
-  // For each tick, recent_cpu is incremented by 1 for the current thread.
-  struct thread* t = thread_current();
-  t->recent_cpu = t->recent_cpu + F;
-
-  if(timer_ticks() % 4 == 0)
-  {
-    compute_priority_for_all_threads ();
-  }
-
-  if(timer_ticks() % TIMER_FREQ == 0)
-  {
-    compute_recent_cpu_for_all_threads();
-    compute_load_avg();
-  }
+  wake_sleepers (ticks);
 
-  execute_event (ticks);
+  elapsed = timer_cycles () - start;
+  if (elapsed > max_interrupt_cycles)
+    max_interrupt_cycles = elapsed;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -0,0 +1,381 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in the cache. */
+#define CACHE_CNT 64
+
+/* Timer ticks between write-behind passes. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ)
+
+/* Maximum number of sectors waiting to be read ahead. */
+#define PREFETCH_CNT 64
+
+/* Marks an entry that holds no sector. */
+#define NO_SECTOR ((block_sector_t) -1)
+
+/* A cached sector.
+
+   An entry is pinned while a thread is using it, and a pinned
+   entry is never evicted, so a thread that has pinned an entry
+   can wait for its lock without holding cache_lock. */
+struct cache_entry
+  {
+    /* Protected by cache_lock. */
+    block_sector_t sector;      /* Sector cached here, or NO_SECTOR. */
+    block_sector_t old_sector;  /* Evicted sector being written back. */
+    int pin_cnt;                /* Number of threads using this entry. */
+    bool accessed;              /* Used since the clock hand passed? */
+
+    /* Protected by LOCK. */
+    struct lock lock;           /* Serializes access to the data. */
+    bool valid;                 /* DATA holds the sector's contents? */
+    bool dirty;                 /* DATA is newer than the disk? */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes of data. */
+  };
+
+/* The cache. */
+static struct cache_entry entries[CACHE_CNT];
+
+/* Protects the sector held by each entry, the pin counts, and the
+   clock hand. */
+static struct lock cache_lock;
+
+/* Signaled when an entry becomes unpinned. */
+static struct condition cache_unpinned;
+
+/* Next entry to consider for eviction. */
+static size_t clock_hand;
+
+/* Sectors waiting to be read ahead, in a circular queue. */
+static block_sector_t prefetch_queue[PREFETCH_CNT];
+static size_t prefetch_head, prefetch_cnt;
+static struct lock prefetch_lock;
+static struct condition prefetch_ready;
+
+/* Statistics. */
+static long long hit_cnt;       /* Sectors found in the cache. */
+static long long miss_cnt;      /* Sectors not found in the cache. */
+static long long writeback_cnt; /* Dirty sectors written to disk. */
+static long long readahead_cnt; /* Sectors read in ahead of use. */
+
+static void flusher (void *aux);
+static void prefetcher (void *aux);
+static struct cache_entry *get_entry (block_sector_t);
+static void put_entry (struct cache_entry *, long long *stat);
+static struct cache_entry *lookup (block_sector_t);
+static struct cache_entry *find_victim (void);
+static void unpin (struct cache_entry *);
+
+/* Initializes the buffer cache and starts its write-behind and
+   read-ahead threads. */
+void
+cache_init (void)
+{
+  uint8_t *data;
+  size_t i;
+
+  data = palloc_get_multiple (PAL_ASSERT,
+                              CACHE_CNT * BLOCK_SECTOR_SIZE / PGSIZE);
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &entries[i];
+      e->sector = e->old_sector = NO_SECTOR;
+      e->pin_cnt = 0;
+      e->accessed = false;
+      lock_init (&e->lock);
+      e->valid = e->dirty = false;
+      e->data = data + i * BLOCK_SECTOR_SIZE;
+    }
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  lock_init (&prefetch_lock);
+  cond_init (&prefetch_ready);
+
+  thread_create ("flusher", PRI_DEFAULT, flusher, NULL);
+  thread_create ("prefetcher", PRI_DEFAULT, prefetcher, NULL);
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within SECTOR on
+   the file system device into BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+  long long *stat;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = get_entry (sector);
+  stat = e->valid ? &hit_cnt : &miss_cnt;
+  if (!e->valid)
+    {
+      block_read (fs_device, sector, e->data);
+      e->valid = true;
+    }
+  memcpy (buffer, e->data + ofs, size);
+  put_entry (e, stat);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR on the file system
+   device, starting at byte offset OFS within the sector.  The
+   write reaches the disk later, when the sector is evicted or
+   flushed. */
+void
+cache_write (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+  long long *stat;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = get_entry (sector);
+  stat = e->valid ? &hit_cnt : &miss_cnt;
+  if (!e->valid && size < BLOCK_SECTOR_SIZE)
+    block_read (fs_device, sector, e->data);
+  memcpy (e->data + ofs, buffer, size);
+  e->valid = true;
+  e->dirty = true;
+  put_entry (e, stat);
+}
+
+/* Asks for SECTOR to be read into the cache in the background,
+   without waiting for it.  The request is dropped if too many
+   are already waiting. */
+void
+cache_prefetch (block_sector_t sector)
+{
+  lock_acquire (&prefetch_lock);
+  if (prefetch_cnt < PREFETCH_CNT)
+    {
+      prefetch_queue[(prefetch_head + prefetch_cnt++) % PREFETCH_CNT]
+        = sector;
+      cond_signal (&prefetch_ready, &prefetch_lock);
+    }
+  lock_release (&prefetch_lock);
+}
+
+/* Writes every dirty sector in the cache to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &entries[i];
+      bool written = false;
+
+      lock_acquire (&cache_lock);
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+
+      lock_acquire (&e->lock);
+      if (e->valid && e->dirty)
+        {
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+          written = true;
+        }
+      lock_release (&e->lock);
+
+      lock_acquire (&cache_lock);
+      if (written)
+        writeback_cnt++;
+      unpin (e);
+      lock_release (&cache_lock);
+    }
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Buffer cache: %lld hits, %lld misses, %lld writebacks, "
+          "%lld read ahead\n",
+          hit_cnt, miss_cnt, writeback_cnt, readahead_cnt);
+}
+
+/* Write-behind thread.  Flushes the cache every FLUSH_INTERVAL
+   ticks, so that a crash loses at most that much work. */
+static void
+flusher (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_flush ();
+    }
+}
+
+/* Read-ahead thread.  Reads in the sectors queued by
+   cache_prefetch() that are not already in the cache. */
+static void
+prefetcher (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      struct cache_entry *e;
+      long long *stat;
+      bool cached;
+
+      lock_acquire (&prefetch_lock);
+      while (prefetch_cnt == 0)
+        cond_wait (&prefetch_ready, &prefetch_lock);
+      sector = prefetch_queue[prefetch_head];
+      prefetch_head = (prefetch_head + 1) % PREFETCH_CNT;
+      prefetch_cnt--;
+      lock_release (&prefetch_lock);
+
+      lock_acquire (&cache_lock);
+      cached = lookup (sector) != NULL;
+      lock_release (&cache_lock);
+      if (cached)
+        continue;
+
+      e = get_entry (sector);
+      stat = NULL;
+      if (!e->valid)
+        {
+          block_read (fs_device, sector, e->data);
+          e->valid = true;
+          stat = &readahead_cnt;
+        }
+      put_entry (e, stat);
+    }
+}
+
+/* Returns the cache entry for SECTOR, pinned and with its lock
+   held, evicting another sector to make room if necessary.  If
+   the entry's data is not valid, the caller must read it in (or
+   overwrite all of it).  Call put_entry() when done. */
+static struct cache_entry *
+get_entry (block_sector_t sector)
+{
+  struct cache_entry *e;
+  block_sector_t old_sector;
+  bool dirty;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL && e->sector == sector)
+        {
+          /* Hit. */
+          e->accessed = true;
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+
+          lock_acquire (&e->lock);
+          return e;
+        }
+      else if (e != NULL)
+        {
+          /* SECTOR was just evicted from E and is still on its
+             way to disk.  Wait until it gets there, then look
+             again. */
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          lock_release (&e->lock);
+          lock_acquire (&cache_lock);
+          unpin (e);
+        }
+      else if ((e = find_victim ()) != NULL)
+        break;
+      else
+        cond_wait (&cache_unpinned, &cache_lock);
+    }
+
+  /* Miss.  Take over E, which is unpinned and so also unlocked.
+     If it is dirty, write back its old sector, which stays
+     reserved in the meantime. */
+  e->accessed = true;
+  e->pin_cnt++;
+  lock_acquire (&e->lock);
+  dirty = e->valid && e->dirty;
+  old_sector = e->sector;
+  if (dirty)
+    e->old_sector = old_sector;
+  e->sector = sector;
+  lock_release (&cache_lock);
+
+  if (dirty)
+    {
+      block_write (fs_device, old_sector, e->data);
+      lock_acquire (&cache_lock);
+      e->old_sector = NO_SECTOR;
+      writeback_cnt++;
+      lock_release (&cache_lock);
+    }
+  e->valid = e->dirty = false;
+  return e;
+}
+
+/* Releases entry E obtained from get_entry(), and increments
+   *STAT if it is nonnull. */
+static void
+put_entry (struct cache_entry *e, long long *stat)
+{
+  lock_release (&e->lock);
+  lock_acquire (&cache_lock);
+  if (stat != NULL)
+    (*stat)++;
+  unpin (e);
+  lock_release (&cache_lock);
+}
+
+/* Returns the entry that holds SECTOR or is writing it back, or a
+   null pointer if there is none.  cache_lock must be held. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < CACHE_CNT; i++)
+    if (entries[i].sector == sector || entries[i].old_sector == sector)
+      return &entries[i];
+  return NULL;
+}
+
+/* Chooses an unpinned entry to evict with the clock algorithm:
+   entries used since the hand last passed get a second chance.
+   Returns a null pointer if every entry is pinned.  cache_lock
+   must be held. */
+static struct cache_entry *
+find_victim (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  for (i = 0; i < 2 * CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &entries[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_CNT;
+      if (e->pin_cnt > 0)
+        continue;
+      if (!e->accessed)
+        return e;
+      e->accessed = false;
+    }
+  return NULL;
+}
+
+/* Drops a pin on E.  cache_lock must be held. */
+static void
+unpin (struct cache_entry *e)
+{
+  ASSERT (e->pin_cnt > 0);
+  if (--e->pin_cnt == 0)
+    cond_broadcast (&cache_unpinned, &cache_lock);
+}
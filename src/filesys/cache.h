@@ -0,0 +1,21 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+
+/* Buffer cache of file system device sectors.
+
+   Reads and writes of fs_device sectors by the file system go
+   through here.  Dirty sectors are written back when they are
+   evicted, every few seconds by a background thread, and when
+   cache_flush() is called.  Sectors passed to cache_prefetch()
+   are read in by another background thread. */
+
+void cache_init (void);
+void cache_read (block_sector_t, void *buffer, int ofs, int size);
+void cache_write (block_sector_t, const void *buffer, int ofs, int size);
+void cache_prefetch (block_sector_t);
+void cache_flush (void);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
@@ -1,6 +1,7 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
@@ -21,12 +22,117 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Hashed directories.
+
+   A directory created by dir_create() begins with a sector
+   holding a struct dir_header, followed by BUCKET_CNT buckets of
+   one sector each.  An entry goes in the bucket selected by
+   hashing its name or, if that bucket is full, in the next bucket
+   that has a free slot.  A slot whose name is empty has never
+   been used, so a search can stop at the first bucket that has
+   one.  Buckets past the end of the file are empty.
+
+   When too few never-used slots remain, the entries are rehashed
+   into a table at most half full, so that adding and removing
+   entries takes constant time amortized over many calls.
+
+   Directories written before this format existed are still
+   searched and updated by a linear scan of their entries. */
+
+/* Identifies a hashed directory. */
+#define DIR_MAGIC 0x48534944
+
+/* Number of entries in a bucket. */
+#define BUCKET_ENTRY_CNT (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* Smallest number of buckets in a hashed directory. */
+#define MIN_BUCKET_CNT 4
+
+/* First sector of a hashed directory. */
+struct dir_header
+  {
+    unsigned magic;                     /* DIR_MAGIC. */
+    uint32_t bucket_cnt;                /* Number of buckets. */
+    uint32_t entry_cnt;                 /* Number of entries in use. */
+    uint32_t used_cnt;                  /* Slots ever used since rehash. */
+  };
+
+/* One sector's worth of entries. */
+struct dir_bucket
+  {
+    struct dir_entry entries[BUCKET_ENTRY_CNT];
+  };
+
+/* Maximum number of names remembered for a directory. */
+#define NAME_CACHE_CNT 64
+
+/* A name looked up in, or added to, an open directory.  Each
+   open directory inode has a hash table of these attached, so
+   repeated lookups of a name skip the directory's contents. */
+struct cached_name
+  {
+    struct hash_elem elem;              /* Element in name cache. */
+    char name[NAME_MAX + 1];            /* File name. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+  };
+
+static bool read_header (struct inode *, struct dir_header *);
+static bool read_bucket (struct inode *, uint32_t bucket,
+                         struct dir_bucket *);
+static bool add_hashed (struct inode *, struct dir_header *,
+                        const char *name, block_sector_t,
+                        struct dir_bucket *);
+static bool place_entry (struct inode *, struct dir_header *,
+                         const struct dir_entry *, struct dir_bucket *);
+static bool bucket_is_empty (const struct dir_bucket *);
+static bool rehash (struct inode *, struct dir_header *, size_t entry_cnt,
+                    struct dir_bucket *);
+static uint32_t bucket_cnt_for (size_t entry_cnt);
+
+static bool name_cache_find (struct inode *, const char *name,
+                             block_sector_t *);
+static void name_cache_add (struct inode *, const char *name,
+                            block_sector_t);
+static void name_cache_remove (struct inode *, const char *name);
+
+/* Returns the byte offset of slot SLOT in BUCKET of a hashed
+   directory. */
+static inline off_t
+slot_ofs (uint32_t bucket, size_t slot)
+{
+  return (bucket + 1) * BLOCK_SECTOR_SIZE + slot * sizeof (struct dir_entry);
+}
+
+/* Returns the bucket where the search for NAME starts in a hashed
+   directory with header H. */
+static inline uint32_t
+home_bucket (const struct dir_header *h, const char *name)
+{
+  return hash_string (name) % h->bucket_cnt;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header h;
+  struct inode *inode;
+  bool success;
+
+  if (!inode_create (sector, sizeof h))
+    return false;
+  inode = inode_open (sector);
+  if (inode == NULL)
+    return false;
+
+  /* The buckets stay unallocated until entries are added. */
+  h.magic = DIR_MAGIC;
+  h.bucket_cnt = bucket_cnt_for (entry_cnt);
+  h.entry_cnt = h.used_cnt = 0;
+  success = inode_write_at (inode, &h, sizeof h, 0) == sizeof h;
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -87,17 +193,54 @@ dir_get_inode (struct dir *dir)
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   B is scratch space for searching a hashed directory. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+        struct dir_entry *ep, off_t *ofsp, struct dir_bucket *b) 
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir->inode, &h))
+    {
+      uint32_t bucket, i;
+      bool found = false;
+
+      bucket = home_bucket (&h, name);
+      for (i = 0; i < h.bucket_cnt && !found; i++)
+        {
+          bool never_used = false;
+          size_t slot;
+
+          if (!read_bucket (dir->inode, bucket, b))
+            break;
+          for (slot = 0; slot < BUCKET_ENTRY_CNT; slot++)
+            {
+              struct dir_entry *be = &b->entries[slot];
+              if (be->in_use && !strcmp (name, be->name))
+                {
+                  if (ep != NULL)
+                    *ep = *be;
+                  if (ofsp != NULL)
+                    *ofsp = slot_ofs (bucket, slot);
+                  found = true;
+                  break;
+                }
+              else if (be->name[0] == '\0')
+                never_used = true;
+            }
+          if (never_used)
+            break;
+          bucket = (bucket + 1) % h.bucket_cnt;
+        }
+      return found;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -120,14 +263,24 @@ dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
   struct dir_entry e;
+  struct dir_bucket *b;
+  block_sector_t sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  *inode = NULL;
+  if (name_cache_find (dir->inode, name, &sector))
+    *inode = inode_open (sector);
+  else if ((b = malloc (sizeof *b)) != NULL)
+    {
+      if (lookup (dir, name, &e, NULL, b))
+        {
+          name_cache_add (dir->inode, name, e.inode_sector);
+          *inode = inode_open (e.inode_sector);
+        }
+      free (b);
+    }
 
   return *inode != NULL;
 }
@@ -141,7 +294,9 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_header h;
   struct dir_entry e;
+  struct dir_bucket *b;
   off_t ofs;
   bool success = false;
 
@@ -152,10 +307,22 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  /* Without memory to search DIR, we can't tell whether NAME is
+     already there. */
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  if (lookup (dir, name, NULL, NULL, b))
     goto done;
 
+  if (read_header (dir->inode, &h))
+    {
+      success = add_hashed (dir->inode, &h, name, inode_sector, b);
+      goto done;
+    }
+
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
      current end-of-file.
@@ -175,6 +342,9 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
  done:
+  free (b);
+  if (success)
+    name_cache_add (dir->inode, name, inode_sector);
   return success;
 }
 
@@ -184,8 +354,11 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_header h;
   struct dir_entry e;
+  struct dir_bucket *b;
   struct inode *inode = NULL;
+  bool found;
   bool success = false;
   off_t ofs;
 
@@ -193,7 +366,12 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+  found = lookup (dir, name, &e, &ofs, b);
+  free (b);
+  if (!found)
     goto done;
 
   /* Open inode. */
@@ -201,10 +379,17 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
+  /* Erase directory entry.  Its name stays behind, so that
+     searches in a hashed directory go on past the slot. */
+  name_cache_remove (dir->inode, name);
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  if (read_header (dir->inode, &h))
+    {
+      h.entry_cnt--;
+      inode_write_at (dir->inode, &h, sizeof h, 0);
+    }
 
   /* Remove inode. */
   inode_remove (inode);
@@ -221,8 +406,28 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
 
+  if (read_header (dir->inode, &h))
+    {
+      /* In a hashed directory, POS counts slots. */
+      while ((uint32_t) dir->pos < h.bucket_cnt * BUCKET_ENTRY_CNT)
+        {
+          off_t ofs = slot_ofs (dir->pos / BUCKET_ENTRY_CNT,
+                                dir->pos % BUCKET_ENTRY_CNT);
+          if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            break;
+          dir->pos++;
+          if (e.in_use)
+            {
+              strlcpy (name, e.name, NAME_MAX + 1);
+              return true;
+            }
+        }
+      return false;
+    }
+
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
@@ -234,3 +439,308 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
     }
   return false;
 }
+
+/* Reads the header of the directory in INODE into *H.  Returns
+   true if INODE is a hashed directory, false if it is in the old
+   linear format. */
+static bool
+read_header (struct inode *inode, struct dir_header *h)
+{
+  return (inode_read_at (inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_MAGIC && h->bucket_cnt > 0);
+}
+
+/* Reads BUCKET of the hashed directory in INODE into B.  A bucket
+   past the end of the file reads as empty.  Returns true if
+   successful, false on failure. */
+static bool
+read_bucket (struct inode *inode, uint32_t bucket, struct dir_bucket *b)
+{
+  off_t ofs = slot_ofs (bucket, 0);
+  off_t size = inode_length (inode) - ofs;
+
+  memset (b, 0, sizeof *b);
+  if (size <= 0)
+    return true;
+  if (size > (off_t) sizeof *b)
+    size = sizeof *b;
+  return inode_read_at (inode, b, size, ofs) == size;
+}
+
+/* Adds an entry for NAME, whose inode is in INODE_SECTOR, to the
+   hashed directory in INODE, whose header is H, rehashing first if
+   too few never-used slots are left.  B is scratch space.  Returns
+   true if successful, false on failure. */
+static bool
+add_hashed (struct inode *inode, struct dir_header *h, const char *name,
+            block_sector_t inode_sector, struct dir_bucket *b)
+{
+  struct dir_entry e;
+
+  if ((h->used_cnt + 1) * 4 > h->bucket_cnt * BUCKET_ENTRY_CNT * 3
+      && !rehash (inode, h, h->entry_cnt + 1, b))
+    return false;
+
+  memset (&e, 0, sizeof e);
+  e.in_use = true;
+  strlcpy (e.name, name, sizeof e.name);
+  e.inode_sector = inode_sector;
+  return (place_entry (inode, h, &e, b)
+          && inode_write_at (inode, h, sizeof *h, 0) == sizeof *h);
+}
+
+/* Writes E into the first free slot on its search path in the
+   hashed directory in INODE, and updates the counts in header H,
+   which the caller must write back.  B is scratch space.  Returns
+   true if successful, false on failure. */
+static bool
+place_entry (struct inode *inode, struct dir_header *h,
+             const struct dir_entry *e, struct dir_bucket *b)
+{
+  uint32_t bucket, i;
+
+  bucket = home_bucket (h, e->name);
+  for (i = 0; i < h->bucket_cnt; i++)
+    {
+      size_t slot;
+
+      if (!read_bucket (inode, bucket, b))
+        return false;
+      for (slot = 0; slot < BUCKET_ENTRY_CNT; slot++)
+        if (!b->entries[slot].in_use)
+          {
+            off_t ofs = slot_ofs (bucket, slot);
+            if (inode_write_at (inode, e, sizeof *e, ofs) != sizeof *e)
+              return false;
+            if (b->entries[slot].name[0] == '\0')
+              h->used_cnt++;
+            h->entry_cnt++;
+            return true;
+          }
+      bucket = (bucket + 1) % h->bucket_cnt;
+    }
+  return false;
+}
+
+/* Returns true if no slot in bucket B has ever been used. */
+static bool
+bucket_is_empty (const struct dir_bucket *b)
+{
+  size_t slot;
+
+  for (slot = 0; slot < BUCKET_ENTRY_CNT; slot++)
+    if (b->entries[slot].name[0] != '\0')
+      return false;
+  return true;
+}
+
+/* Rebuilds the hashed directory in INODE, whose header is H, with
+   enough buckets for ENTRY_CNT entries, dropping the names left
+   behind by removed entries.  Updates and writes back H.  B is
+   scratch space.  Returns true if successful, false on failure.
+   A failure to allocate disk space or memory leaves the directory
+   unchanged. */
+static bool
+rehash (struct inode *inode, struct dir_header *h, size_t entry_cnt,
+        struct dir_bucket *b)
+{
+  struct dir_entry *entries;
+  uint32_t old_bucket_cnt = h->bucket_cnt;
+  uint32_t new_bucket_cnt = bucket_cnt_for (entry_cnt);
+  size_t cnt = 0;
+  uint32_t bucket;
+  bool success = true;
+
+  ASSERT (entry_cnt > h->entry_cnt);
+
+  entries = malloc (entry_cnt * sizeof *entries);
+  if (entries == NULL)
+    return false;
+
+  /* Collect the entries in use. */
+  for (bucket = 0; bucket < old_bucket_cnt; bucket++)
+    {
+      size_t slot;
+
+      if (!read_bucket (inode, bucket, b))
+        goto fail;
+      for (slot = 0; slot < BUCKET_ENTRY_CNT; slot++)
+        if (b->entries[slot].in_use && cnt < entry_cnt)
+          entries[cnt++] = b->entries[slot];
+    }
+
+  /* Allocate every new bucket before changing anything, by
+     writing zeros over each one that holds no names, so that
+     running out of disk space loses nothing.  Writing them in
+     order, instead of as entries happen to land in them, also
+     keeps the directory's sectors together on disk. */
+  for (bucket = 0; bucket < new_bucket_cnt; bucket++)
+    {
+      if (bucket < old_bucket_cnt)
+        {
+          if (!read_bucket (inode, bucket, b))
+            goto fail;
+          if (!bucket_is_empty (b))
+            continue;
+        }
+      memset (b, 0, sizeof *b);
+      if (inode_write_at (inode, b, sizeof *b, slot_ofs (bucket, 0))
+          != sizeof *b)
+        goto fail;
+    }
+
+  /* From here on, only sectors already allocated are written.
+     Empty the old buckets that held names, then put the entries
+     back.  Even if a write fails anyway, every entry is still
+     tried, so that as few as possible go missing. */
+  for (bucket = 0; bucket < old_bucket_cnt; bucket++)
+    {
+      if (!read_bucket (inode, bucket, b))
+        success = false;
+      else if (!bucket_is_empty (b))
+        {
+          memset (b, 0, sizeof *b);
+          if (inode_write_at (inode, b, sizeof *b, slot_ofs (bucket, 0))
+              != sizeof *b)
+            success = false;
+        }
+    }
+  h->bucket_cnt = new_bucket_cnt;
+  h->entry_cnt = h->used_cnt = 0;
+  while (cnt > 0)
+    if (!place_entry (inode, h, &entries[--cnt], b))
+      success = false;
+  if (inode_write_at (inode, h, sizeof *h, 0) != sizeof *h)
+    success = false;
+  free (entries);
+  return success;
+
+ fail:
+  free (entries);
+  return false;
+}
+
+/* Returns the number of buckets for a hashed directory of
+   ENTRY_CNT entries, leaving at least half its slots free. */
+static uint32_t
+bucket_cnt_for (size_t entry_cnt)
+{
+  uint32_t bucket_cnt = MIN_BUCKET_CNT;
+
+  while (entry_cnt * 2 > bucket_cnt * BUCKET_ENTRY_CNT)
+    bucket_cnt *= 2;
+  return bucket_cnt;
+}
+
+/* Name cache. */
+
+/* Returns a hash value for cached name E. */
+static unsigned
+cached_name_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct cached_name, elem)->name);
+}
+
+/* Returns true if cached name A precedes cached name B. */
+static bool
+cached_name_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct cached_name, elem)->name,
+                 hash_entry (b, struct cached_name, elem)->name) < 0;
+}
+
+/* Frees cached name E. */
+static void
+cached_name_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct cached_name, elem));
+}
+
+/* Frees the name cache CACHE when its inode is closed. */
+static void
+name_cache_destroy (void *cache)
+{
+  hash_destroy (cache, cached_name_free);
+  free (cache);
+}
+
+/* Returns the name cache attached to directory INODE, creating
+   it if necessary, or a null pointer if memory is short. */
+static struct hash *
+get_name_cache (struct inode *inode)
+{
+  struct hash *cache = inode_get_aux (inode);
+
+  if (cache == NULL)
+    {
+      cache = malloc (sizeof *cache);
+      if (cache == NULL)
+        return NULL;
+      if (!hash_init (cache, cached_name_hash, cached_name_less, NULL))
+        {
+          free (cache);
+          return NULL;
+        }
+      inode_set_aux (inode, cache, name_cache_destroy);
+    }
+  return cache;
+}
+
+/* Looks up NAME in directory INODE's name cache.  If it is there,
+   sets *SECTOR to its inode's sector and returns true. */
+static bool
+name_cache_find (struct inode *inode, const char *name,
+                 block_sector_t *sector)
+{
+  struct hash *cache = inode_get_aux (inode);
+  struct cached_name key;
+  struct hash_elem *e;
+
+  if (cache == NULL || strlen (name) > NAME_MAX)
+    return false;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (cache, &key.elem);
+  if (e == NULL)
+    return false;
+  *sector = hash_entry (e, struct cached_name, elem)->inode_sector;
+  return true;
+}
+
+/* Records in directory INODE's name cache that NAME's inode is in
+   SECTOR.  The cache is emptied when it fills up. */
+static void
+name_cache_add (struct inode *inode, const char *name, block_sector_t sector)
+{
+  struct hash *cache = get_name_cache (inode);
+  struct cached_name *n;
+
+  if (cache == NULL)
+    return;
+  if (hash_size (cache) >= NAME_CACHE_CNT)
+    hash_clear (cache, cached_name_free);
+
+  n = malloc (sizeof *n);
+  if (n == NULL)
+    return;
+  strlcpy (n->name, name, sizeof n->name);
+  n->inode_sector = sector;
+  if (hash_insert (cache, &n->elem) != NULL)
+    free (n);
+}
+
+/* Forgets NAME in directory INODE's name cache. */
+static void
+name_cache_remove (struct inode *inode, const char *name)
+{
+  struct hash *cache = inode_get_aux (inode);
+  struct cached_name key;
+  struct hash_elem *e;
+
+  if (cache == NULL || strlen (name) > NAME_MAX)
+    return;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_delete (cache, &key.elem);
+  if (e != NULL)
+    cached_name_free (e, NULL);
+}
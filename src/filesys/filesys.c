@@ -2,10 +2,12 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "threads/interrupt.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -21,6 +23,7 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
   free_map_init ();
 
@@ -31,11 +34,15 @@ filesys_init (bool format)
 }
 
 /* Shuts down the file system module, writing any unwritten data
-   to disk. */
+   to disk.  After a kernel panic, which turns interrupts off,
+   the unwritten data is lost instead: the panicking thread may
+   hold cache locks, and disk writes cannot complete. */
 void
 filesys_done (void) 
 {
   free_map_close ();
+  if (!intr_context () && intr_get_level () == INTR_ON)
+    cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -40,6 +40,60 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates up to CNT consecutive sectors from the free map,
+   CNT of them if at all possible, and stores the first into
+   *SECTORP.  Prefers the sectors starting at HINT, then the first
+   free run of CNT sectors, then shorter runs.
+   Returns the number of sectors allocated, or 0 if the disk is
+   full or the free_map file could not be written. */
+size_t
+free_map_allocate_run (size_t cnt, block_sector_t hint,
+                       block_sector_t *sectorp)
+{
+  size_t sector_cnt = bitmap_size (free_map);
+  size_t hint_cnt = 0;
+  size_t sector = BITMAP_ERROR;
+  size_t got;
+
+  ASSERT (cnt > 0);
+
+  /* Count the free sectors at HINT. */
+  while (hint_cnt < cnt && hint < sector_cnt - hint_cnt
+         && !bitmap_test (free_map, hint + hint_cnt))
+    hint_cnt++;
+
+  if (hint_cnt == cnt)
+    {
+      sector = hint;
+      got = cnt;
+    }
+  else
+    {
+      for (got = cnt; got > hint_cnt; got /= 2)
+        {
+          sector = bitmap_scan (free_map, 0, got, false);
+          if (sector != BITMAP_ERROR)
+            break;
+        }
+      if (sector == BITMAP_ERROR)
+        {
+          if (hint_cnt == 0)
+            return 0;
+          sector = hint;
+          got = hint_cnt;
+        }
+    }
+
+  bitmap_set_multiple (free_map, sector, got, true);
+  if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
+    {
+      bitmap_set_multiple (free_map, sector, got, false);
+      return 0;
+    }
+  *sectorp = sector;
+  return got;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
@@ -72,14 +126,22 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  struct file *file;
+
   /* Create inode. */
   if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  Inodes allocate sectors as they are
+     written, so the first write allocates the free map file's
+     own sectors, marking them in the bitmap as it goes, and the
+     second records the final bitmap.  Until free_map_file is set,
+     free_map_allocate() does not try to write the bitmap, which
+     would recurse.  Afterward the file never needs new sectors. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!bitmap_write (free_map, file) || !bitmap_write (free_map, file))
     PANIC ("can't write free map");
+  free_map_file = file;
 }
@@ -3,21 +3,51 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of contiguous data sectors: sectors OFS through
+   OFS + LENGTH - 1 of a file are stored in disk sectors START
+   through START + LENGTH - 1. */
+struct extent
+  {
+    uint32_t ofs;                       /* First sector within file. */
+    block_sector_t start;               /* First sector on disk. */
+    uint32_t length;                    /* Number of sectors. */
+  };
+
+/* Number of extents stored in the inode itself. */
+#define INODE_EXTENT_CNT 41
+
+/* Number of extents stored in the overflow block. */
+#define OVERFLOW_EXTENT_CNT (BLOCK_SECTOR_SIZE / sizeof (struct extent))
+
+/* Maximum number of extents in a file. */
+#define MAX_EXTENT_CNT (INODE_EXTENT_CNT + OVERFLOW_EXTENT_CNT)
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The file's data sectors are described by a list of extents,
+   sorted by position in the file, of which the first
+   INODE_EXTENT_CNT are stored here and the rest in the overflow
+   block.  File sectors that no extent covers have not been
+   allocated yet.  Such holes read as zeros and get sectors when
+   written. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t extent_cnt;                /* Number of extents. */
+    block_sector_t overflow;            /* Overflow extent block, or 0. */
+    struct extent extents[INODE_EXTENT_CNT]; /* First extents. */
+    uint32_t unused;                    /* Not used. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,6 +58,14 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* Read-ahead window, in sectors, when a sequential read is first
+   seen.  It doubles with each further sequential read, up to
+   inode_readahead_max. */
+#define READAHEAD_MIN 2
+
+/* Maximum read-ahead window, in sectors.  0 disables read-ahead. */
+int inode_readahead_max = 16;
+
 /* In-memory inode. */
 struct inode 
   {
@@ -36,21 +74,172 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct lock lock;                   /* Serializes sector allocation. */
+    off_t next_read;                    /* Where a sequential read starts. */
+    off_t readahead_end;                /* End of data already read ahead. */
+    int readahead_window;               /* Sectors to read ahead. */
     struct inode_disk data;             /* Inode content. */
+    struct extent *extents;             /* All extents, decoded. */
+    void *aux;                          /* Owned by a higher layer. */
+    void (*aux_destroy) (void *aux);    /* Frees AUX, or null. */
   };
 
+static void read_ahead (struct inode *, off_t start, off_t end);
+static block_sector_t allocate_sectors (struct inode *, size_t idx,
+                                        off_t pos, off_t end);
+static bool add_extent (struct inode *, size_t idx,
+                        block_sector_t start, size_t length);
+static size_t find_extent (const struct inode *, size_t idx);
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   If no sector has been allocated there yet, then if END is past
+   POS, allocates sectors for as much as possible of the write of
+   bytes POS through END, exclusive, that is about to happen, and
+   returns the first; otherwise, returns 0.  Also returns 0 if
+   allocation fails.
+   Looking up a sector takes no disk I/O, because the inode keeps
+   its extent list in memory. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos, off_t end) 
 {
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t sector = 0;
+  size_t i;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  ASSERT (pos >= 0);
+
+  lock_acquire (&inode->lock);
+  i = find_extent (inode, idx);
+  if (i > 0 && idx < inode->extents[i - 1].ofs + inode->extents[i - 1].length)
+    sector = inode->extents[i - 1].start + (idx - inode->extents[i - 1].ofs);
+  else if (end > pos)
+    sector = allocate_sectors (inode, idx, pos, end);
+  lock_release (&inode->lock);
+
+  return sector;
+}
+
+/* Returns the number of extents in INODE that start at or before
+   file sector IDX, by binary search. */
+static size_t
+find_extent (const struct inode *inode, size_t idx) 
+{
+  size_t lo = 0, hi = inode->data.extent_cnt;
+
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (inode->extents[mid].ofs <= idx)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Allocates disk sectors for INODE starting at file sector IDX,
+   which holds byte POS, for the write of bytes POS through END,
+   exclusive.  Takes as many sectors as possible in one contiguous
+   run, preferably right after the preceding extent so that the
+   two merge, but stops short of any sector already allocated.
+   The first and last sectors are zeroed if the write covers them
+   only partly; the write will overwrite the rest.
+   Returns the first sector allocated, or 0 if allocation fails.
+   INODE's lock must be held. */
+static block_sector_t
+allocate_sectors (struct inode *inode, size_t idx, off_t pos, off_t end) 
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  size_t i = find_extent (inode, idx);
+  size_t cnt = bytes_to_sectors (end) - idx;
+  block_sector_t hint, start;
+  size_t got;
+
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+
+  if (i < inode->data.extent_cnt && inode->extents[i].ofs - idx < cnt)
+    cnt = inode->extents[i].ofs - idx;
+  if (i > 0)
+    {
+      const struct extent *prev = &inode->extents[i - 1];
+      hint = prev->start + prev->length + (idx - (prev->ofs + prev->length));
+    }
+  else
+    hint = inode->sector + 1;
+
+  got = free_map_allocate_run (cnt, hint, &start);
+  if (got == 0)
+    return 0;
+
+  if (pos % BLOCK_SECTOR_SIZE != 0)
+    cache_write (start, zeros, 0, BLOCK_SECTOR_SIZE);
+  if (got == cnt && end % BLOCK_SECTOR_SIZE != 0)
+    cache_write (start + got - 1, zeros, 0, BLOCK_SECTOR_SIZE);
+
+  if (!add_extent (inode, idx, start, got))
+    {
+      free_map_release (start, got);
+      return 0;
+    }
+  return start;
+}
+
+/* Records in INODE that its LENGTH sectors starting at file
+   sector IDX, which must not be allocated yet, are stored in
+   disk sectors starting at START, merging with the extents
+   around it where possible, and writes the extent list to disk.
+   Returns true if successful, false if INODE has too many
+   extents or its overflow block cannot be allocated. */
+static bool
+add_extent (struct inode *inode, size_t idx, block_sector_t start,
+            size_t length) 
+{
+  struct inode_disk *d = &inode->data;
+  struct extent *e = inode->extents;
+  size_t i = find_extent (inode, idx);
+  bool merge_prev = (i > 0 && e[i - 1].ofs + e[i - 1].length == idx
+                     && e[i - 1].start + e[i - 1].length == start);
+  bool merge_next = (i < d->extent_cnt && idx + length == e[i].ofs
+                     && start + length == e[i].start);
+
+  if (merge_prev && merge_next)
+    {
+      e[i - 1].length += length + e[i].length;
+      memmove (&e[i], &e[i + 1], (d->extent_cnt - i - 1) * sizeof *e);
+      d->extent_cnt--;
+    }
+  else if (merge_prev)
+    e[i - 1].length += length;
+  else if (merge_next)
+    {
+      e[i].ofs = idx;
+      e[i].start = start;
+      e[i].length += length;
+    }
   else
-    return -1;
+    {
+      if (d->extent_cnt >= MAX_EXTENT_CNT)
+        return false;
+      if (d->extent_cnt >= INODE_EXTENT_CNT && d->overflow == 0
+          && !free_map_allocate (1, &d->overflow))
+        return false;
+      memmove (&e[i + 1], &e[i], (d->extent_cnt - i) * sizeof *e);
+      e[i].ofs = idx;
+      e[i].start = start;
+      e[i].length = length;
+      d->extent_cnt++;
+    }
+
+  /* Write back the extents. */
+  memcpy (d->extents, e, (d->extent_cnt < INODE_EXTENT_CNT
+                          ? d->extent_cnt : INODE_EXTENT_CNT) * sizeof *e);
+  if (d->extent_cnt > INODE_EXTENT_CNT)
+    cache_write (d->overflow, e + INODE_EXTENT_CNT, 0,
+                 (d->extent_cnt - INODE_EXTENT_CNT) * sizeof *e);
+  cache_write (inode->sector, d, 0, BLOCK_SECTOR_SIZE);
+  return true;
 }
 
 /* List of open inodes, so that opening a single inode twice
@@ -66,9 +255,10 @@ inode_init (void)
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The data reads as zeros; sectors for it are
+   allocated only as they are written.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails. */
 bool
 inode_create (block_sector_t sector, off_t length)
 {
@@ -84,23 +274,11 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      cache_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
       free (disk_inode);
+      success = true; 
     }
   return success;
 }
@@ -130,6 +308,12 @@ inode_open (block_sector_t sector)
   inode = malloc (sizeof *inode);
   if (inode == NULL)
     return NULL;
+  inode->extents = malloc (MAX_EXTENT_CNT * sizeof *inode->extents);
+  if (inode->extents == NULL)
+    {
+      free (inode);
+      return NULL;
+    }
 
   /* Initialize. */
   list_push_front (&open_inodes, &inode->elem);
@@ -137,7 +321,25 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  lock_init (&inode->lock);
+  inode->next_read = inode->readahead_end = 0;
+  inode->readahead_window = 0;
+  inode->aux = NULL;
+  inode->aux_destroy = NULL;
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+
+  /* Decode the extent list. */
+  ASSERT (inode->data.extent_cnt <= MAX_EXTENT_CNT);
+  if (inode->data.extent_cnt <= INODE_EXTENT_CNT)
+    memcpy (inode->extents, inode->data.extents,
+            inode->data.extent_cnt * sizeof *inode->extents);
+  else
+    {
+      memcpy (inode->extents, inode->data.extents, sizeof inode->data.extents);
+      cache_read (inode->data.overflow, inode->extents + INODE_EXTENT_CNT, 0,
+                  ((inode->data.extent_cnt - INODE_EXTENT_CNT)
+                   * sizeof *inode->extents));
+    }
   return inode;
 }
 
@@ -157,6 +359,24 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns the data attached to INODE with inode_set_aux(), or a
+   null pointer if there is none. */
+void *
+inode_get_aux (const struct inode *inode)
+{
+  return inode->aux;
+}
+
+/* Attaches AUX to INODE for as long as INODE stays open, in place
+   of any data attached before.  DESTROY, if nonnull, is called on
+   AUX when the last opener closes INODE. */
+void
+inode_set_aux (struct inode *inode, void *aux, void (*destroy) (void *aux))
+{
+  inode->aux = aux;
+  inode->aux_destroy = destroy;
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
@@ -176,11 +396,19 @@ inode_close (struct inode *inode)
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
+          size_t i;
+
+          for (i = 0; i < inode->data.extent_cnt; i++)
+            free_map_release (inode->extents[i].start,
+                              inode->extents[i].length);
+          if (inode->data.overflow != 0)
+            free_map_release (inode->data.overflow, 1);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
         }
 
+      if (inode->aux_destroy != NULL)
+        inode->aux_destroy (inode->aux);
+      free (inode->extents);
       free (inode); 
     }
 }
@@ -196,18 +424,37 @@ inode_remove (struct inode *inode)
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+
+   A read that starts where the last one ended is taken as part of
+   a sequential scan, and the sectors after it are read ahead in
+   the background.  The read-ahead window grows with each
+   sequential read and collapses on a random one. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+
+  if (offset == inode->next_read && inode_readahead_max > 0)
+    {
+      int window = inode->readahead_window * 2;
+      if (window < READAHEAD_MIN)
+        window = READAHEAD_MIN;
+      if (window > inode_readahead_max)
+        window = inode_readahead_max;
+      inode->readahead_window = window;
+    }
+  else 
+    {
+      inode->readahead_window = 0;
+      inode->readahead_end = 0;
+    }
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, 0);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,47 +467,63 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  inode->next_read = offset;
+
+  if (inode->readahead_window > 0)
+    read_ahead (inode, offset,
+                offset + inode->readahead_window * BLOCK_SECTOR_SIZE);
 
   return bytes_read;
 }
 
+/* Queues the sectors of INODE that hold bytes START through END,
+   exclusive, for reading into the cache in the background,
+   except those already queued or past the end of the file. */
+static void
+read_ahead (struct inode *inode, off_t start, off_t end) 
+{
+  off_t length = inode_length (inode);
+  off_t pos;
+
+  if (start < inode->readahead_end)
+    start = inode->readahead_end;
+  if (end > length)
+    end = length;
+
+  pos = ROUND_DOWN (start, BLOCK_SECTOR_SIZE);
+  for (; pos < end; pos += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, pos, 0);
+      if (sector != 0)
+        cache_prefetch (sector);
+    }
+  if (end > inode->readahead_end)
+    inode->readahead_end = end;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up, the maximum file size is
+   reached, or an error occurs.
+   A write past end of file extends the inode.  Any gap between
+   the old end of file and OFFSET becomes a hole that reads as
+   zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
@@ -268,51 +531,39 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset,
+                                                  offset + size);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in sector. */
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (sector_idx == 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Extend the file.  This comes after writing the data, so that
+     concurrent readers never see the new length before the new
+     data. */
+  if (bytes_written > 0 && offset > inode->data.length)
+    {
+      lock_acquire (&inode->lock);
+      if (offset > inode->data.length)
+        {
+          inode->data.length = offset;
+          cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+        }
+      lock_release (&inode->lock);
+    }
 
   return bytes_written;
 }
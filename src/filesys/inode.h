@@ -7,11 +7,15 @@
 
 struct bitmap;
 
+extern int inode_readahead_max;
+
 void inode_init (void);
 bool inode_create (block_sector_t, off_t);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
+void *inode_get_aux (const struct inode *);
+void inode_set_aux (struct inode *, void *aux, void (*destroy) (void *aux));
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
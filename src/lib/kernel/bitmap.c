@@ -69,6 +69,64 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns a mask of the bits in element ELEM_IDX that fall
+   between bitmap bits START and END, exclusive.  The element
+   must overlap that range. */
+static inline elem_type
+range_mask (size_t elem_idx, size_t start, size_t end)
+{
+  size_t base = elem_idx * ELEM_BITS;
+  size_t lo = start > base ? start - base : 0;
+  size_t hi = end - base < ELEM_BITS ? end - base : ELEM_BITS;
+  elem_type mask = (elem_type) -1 << lo;
+
+  if (hi < ELEM_BITS)
+    mask &= ((elem_type) 1 << hi) - 1;
+  return mask;
+}
+
+/* Returns the number of 1-bits in X, without relying on a
+   popcnt instruction or a libgcc helper. */
+static inline size_t
+count_ones (elem_type x)
+{
+  const elem_type m1 = (elem_type) -1 / 3;      /* 0x5555... */
+  const elem_type m2 = (elem_type) -1 / 5;      /* 0x3333... */
+  const elem_type m4 = (elem_type) -1 / 17;     /* 0x0f0f... */
+  const elem_type h01 = (elem_type) -1 / 255;   /* 0x0101... */
+
+  x -= (x >> 1) & m1;
+  x = (x & m2) + ((x >> 2) & m2);
+  x = (x + (x >> 4)) & m4;
+  return (x * h01) >> (sizeof (elem_type) - 1) * CHAR_BIT;
+}
+
+/* Returns the index of the first bit at or after START in B that
+   is set to VALUE, or B's size if there is none.  Skips whole
+   elements that hold no such bit. */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value)
+{
+  size_t idx = elem_idx (start);
+  size_t last_idx = elem_cnt (b->bit_cnt);
+  elem_type flip = value ? 0 : (elem_type) -1;
+  elem_type bits;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  bits = (b->bits[idx] ^ flip) & ((elem_type) -1 << (start % ELEM_BITS));
+  while (bits == 0)
+    {
+      if (++idx >= last_idx)
+        return b->bit_cnt;
+      bits = b->bits[idx] ^ flip;
+    }
+
+  start = idx * ELEM_BITS + __builtin_ctzl (bits);
+  return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -217,14 +275,26 @@ bitmap_set_all (struct bitmap *b, bool value)
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t end = start + cnt;
   size_t i;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  if (cnt == 0)
+    return;
+
+  /* Each element is updated atomically, as in bitmap_mark() and
+     bitmap_reset(). */
+  for (i = elem_idx (start); i <= elem_idx (end - 1); i++)
+    {
+      elem_type mask = range_mask (i, start, end);
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[i]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[i]) : "r" (~mask) : "cc");
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -238,11 +308,13 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
+  if (cnt == 0)
+    return 0;
+
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  for (i = elem_idx (start); i <= elem_idx (start + cnt - 1); i++)
+    value_cnt += count_ones (b->bits[i] & range_mask (i, start, start + cnt));
+  return value ? value_cnt : cnt - value_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -250,14 +322,18 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  elem_type flip = value ? 0 : (elem_type) -1;
   size_t i;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
+  if (cnt == 0)
+    return false;
+
+  for (i = elem_idx (start); i <= elem_idx (start + cnt - 1); i++)
+    if (((b->bits[i] ^ flip) & range_mask (i, start, start + cnt)) != 0)
       return true;
   return false;
 }
@@ -298,13 +374,28 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Jump from each bit set to VALUE to the next bit that
+         isn't.  No group can start in between, because it would
+         contain that bit. */
+      for (;;)
+        {
+          size_t end;
+
+          i = find_next (b, i, value);
+          if (i > last)
+            break;
+          end = find_next (b, i, !value);
+          if (end - i >= cnt)
+            return i;
+          i = end;
+        }
     }
   return BITMAP_ERROR;
 }
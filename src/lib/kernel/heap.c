@@ -0,0 +1,192 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* A pairing heap is a tree in which every element is greater
+   than or equal to its children.  Each element points to its
+   leftmost child and to its next sibling.  The `prev' link of a
+   leftmost child points to its parent, and that of any other
+   child to its previous sibling, so that an element can be cut
+   out of the tree in O(1).  The root has null `prev' and `next'
+   links.
+
+   All restructuring is done by linking two trees, which makes
+   the root with the smaller value the leftmost child of the
+   other.  Removing an element leaves its children as a list of
+   trees; heap_merge_pairs() links them back together with the
+   standard two passes, iteratively so as not to use stack space
+   in proportion to the number of children. */
+
+/* Returns true if A comes out of heap H before B: either A is
+   greater than B, or they compare equal and A was pushed
+   first. */
+static bool
+heap_before (const struct heap *h, const struct heap_elem *a,
+             const struct heap_elem *b)
+{
+  if (h->less (b, a, h->aux))
+    return true;
+  else if (h->less (a, b, h->aux))
+    return false;
+  else
+    return (int) (a->seq - b->seq) < 0;
+}
+
+/* Links trees A and B, whose roots must have null `prev' and
+   `next' links, and returns the root of the result. */
+static struct heap_elem *
+heap_link (const struct heap *h, struct heap_elem *a, struct heap_elem *b)
+{
+  struct heap_elem *winner, *loser;
+
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+
+  if (heap_before (h, a, b))
+    winner = a, loser = b;
+  else
+    winner = b, loser = a;
+
+  loser->next = winner->child;
+  if (winner->child != NULL)
+    winner->child->prev = loser;
+  loser->prev = winner;
+  winner->child = loser;
+  return winner;
+}
+
+/* Links the list of sibling trees that starts at FIRST into a
+   single tree and returns its root, or a null pointer if FIRST
+   is null. */
+static struct heap_elem *
+heap_merge_pairs (const struct heap *h, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* First pass: link pairs from left to right, collecting the
+     results in reverse order through their `next' links. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+      struct heap_elem *pair;
+
+      first = b != NULL ? b->next : NULL;
+      a->prev = a->next = NULL;
+      if (b != NULL)
+        b->prev = b->next = NULL;
+      pair = heap_link (h, a, b);
+      pair->next = pairs;
+      pairs = pair;
+    }
+
+  /* Second pass: link the pairs from right to left. */
+  while (pairs != NULL)
+    {
+      struct heap_elem *next = pairs->next;
+      pairs->next = NULL;
+      root = heap_link (h, pairs, root);
+      pairs = next;
+    }
+
+  return root;
+}
+
+/* Initializes H as an empty heap ordered by LESS given auxiliary
+   data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) 
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->next_seq = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e) 
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  e->seq = h->next_seq++;
+  h->root = heap_link (h, h->root, e);
+}
+
+/* Returns the greatest element in H, which must not be empty,
+   without removing it. */
+struct heap_elem *
+heap_top (struct heap *h) 
+{
+  ASSERT (!heap_empty (h));
+
+  return h->root;
+}
+
+/* Removes and returns the greatest element in H, which must not
+   be empty. */
+struct heap_elem *
+heap_pop (struct heap *h) 
+{
+  struct heap_elem *e = heap_top (h);
+
+  heap_remove (h, e);
+  return e;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e) 
+{
+  struct heap_elem *children;
+
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  children = e->child;
+  e->child = NULL;
+  if (e == h->root)
+    h->root = heap_merge_pairs (h, children);
+  else 
+    {
+      /* Cut E, with its subtree, out of its sibling list. */
+      if (e->prev->child == e)
+        e->prev->child = e->next;
+      else
+        e->prev->next = e->next;
+      if (e->next != NULL)
+        e->next->prev = e->prev;
+      e->prev = e->next = NULL;
+
+      h->root = heap_link (h, h->root, heap_merge_pairs (h, children));
+    }
+}
+
+/* Restores the order of H after the value of E, which must be in
+   H, has changed.  E keeps its place among equal elements. */
+void
+heap_update (struct heap *h, struct heap_elem *e) 
+{
+  unsigned seq = e->seq;
+
+  heap_remove (h, e);
+  e->child = e->next = e->prev = NULL;
+  e->seq = seq;
+  h->root = heap_link (h, h->root, e);
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (struct heap *h) 
+{
+  ASSERT (h != NULL);
+
+  return h->root == NULL;
+}
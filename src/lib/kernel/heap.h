@@ -0,0 +1,69 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Priority queue.
+
+   This is a pairing heap.  Like the lists in list.h and the hash
+   tables in hash.h, it does not use dynamic allocation: each
+   structure that can potentially be in a heap must embed a
+   struct heap_elem member, and the heap_entry macro converts
+   from a struct heap_elem back to the structure that contains
+   it.  See list.h for a detailed explanation of the technique.
+
+   The heap is ordered by a heap_less_func supplied at
+   initialization.  heap_top() and heap_pop() return the
+   *greatest* element, like list_max().  Elements that compare
+   equal come out in the order they were pushed, so a heap can
+   stand in for a FIFO queue with priorities.
+
+   Costs: heap_push() O(1); heap_top() O(1); heap_pop(),
+   heap_remove() and heap_update() O(log n) amortized. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem 
+  {
+    struct heap_elem *child;    /* Leftmost child. */
+    struct heap_elem *next;     /* Next sibling. */
+    struct heap_elem *prev;     /* Previous sibling, or parent. */
+    unsigned seq;               /* Push order, to break ties. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child    \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap 
+  {
+    struct heap_elem *root;     /* Greatest element, or null. */
+    unsigned next_seq;          /* Sequence number for next push. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_top (struct heap *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+bool heap_empty (struct heap *);
+
+#endif /* lib/kernel/heap.h */
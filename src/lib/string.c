@@ -1,5 +1,68 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* Below this many bytes, the setup cost of the string
+   instructions outweighs their speed, so the functions below
+   just go a byte at a time. */
+#define WORD_THRESHOLD 16
+
+/* A 32-bit word that may alias an object of any type. */
+typedef uint32_t word_t __attribute__ ((may_alias));
+
+/* Copies SIZE bytes from SRC to DST in ascending address order.
+   Aligns DST to a word boundary, then copies whole words with
+   `rep movsl', then the remaining bytes. */
+static inline void
+copy_up (unsigned char *dst, const unsigned char *src, size_t size) 
+{
+  if (size >= WORD_THRESHOLD) 
+    {
+      size_t head = -(uintptr_t) dst & 3;
+      size_t words;
+
+      size -= head;
+      words = size / 4;
+      size %= 4;
+      asm volatile ("rep movsb"
+                    : "+D" (dst), "+S" (src), "+c" (head) : : "memory");
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+    }
+  asm volatile ("rep movsb"
+                : "+D" (dst), "+S" (src), "+c" (size) : : "memory");
+}
+
+/* Copies SIZE bytes from SRC to DST in descending address order,
+   for moves to an overlapping, higher destination.  Like
+   copy_up(), but aligns the end of DST and runs the string
+   instruction with the direction flag set. */
+static inline void
+copy_down (unsigned char *dst, const unsigned char *src, size_t size) 
+{
+  dst += size;
+  src += size;
+  if (size >= WORD_THRESHOLD) 
+    {
+      size_t tail = (uintptr_t) dst & 3;
+      size_t words;
+
+      size -= tail;
+      while (tail-- > 0)
+        *--dst = *--src;
+
+      words = size / 4;
+      size %= 4;
+      dst -= 4;
+      src -= 4;
+      asm volatile ("std; rep movsl; cld"
+                    : "+D" (dst), "+S" (src), "+c" (words) : : "memory");
+      dst += 4;
+      src += 4;
+    }
+  while (size-- > 0)
+    *--dst = *--src;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,8 +75,7 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
+  copy_up (dst, src, size);
 
   return dst_;
 }
@@ -29,20 +91,13 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
+  /* Copying upward is safe unless DST overlaps the end of SRC. */
+  if (dst <= src || dst >= src + size) 
+    copy_up (dst, src, size);
   else 
-    {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
-    }
+    copy_down (dst, src, size);
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -58,6 +113,10 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip equal words, then find the differing byte. */
+  for (; size >= 4; a += 4, b += 4, size -= 4)
+    if (*(const word_t *) a != *(const word_t *) b)
+      break;
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -279,11 +338,26 @@ void *
 memset (void *dst_, int value, size_t size) 
 {
   unsigned char *dst = dst_;
+  uint32_t word = (unsigned char) value * 0x01010101u;
 
   ASSERT (dst != NULL || size == 0);
-  
-  while (size-- > 0)
-    *dst++ = value;
+
+  /* Align DST, then store whole words with `rep stosl'. */
+  if (size >= WORD_THRESHOLD) 
+    {
+      size_t head = -(uintptr_t) dst & 3;
+      size_t words;
+
+      size -= head;
+      words = size / 4;
+      size %= 4;
+      asm volatile ("rep stosb"
+                    : "+D" (dst), "+c" (head) : "a" (word) : "memory");
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (words) : "a" (word) : "memory");
+    }
+  asm volatile ("rep stosb"
+                : "+D" (dst), "+c" (size) : "a" (word) : "memory");
 
   return dst_;
 }
@@ -0,0 +1,4 @@
+/* Runs seq-bench with read-ahead turned off by the kernel's
+   -ra=0 option, for comparison with seq-bench. */
+
+#include "tests/filesys/base/seq-bench.inc"
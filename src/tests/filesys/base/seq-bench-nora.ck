@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF'];
+(seq-bench-nora) begin
+(seq-bench-nora) create "bench"
+(seq-bench-nora) open "bench"
+(seq-bench-nora) writing "bench"
+(seq-bench-nora) close "bench"
+(seq-bench-nora) verified contents of "bench"
+(seq-bench-nora) verified contents of "bench"
+(seq-bench-nora) verified contents of "bench"
+(seq-bench-nora) verified contents of "bench"
+(seq-bench-nora) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+/* Writes a file twice the size of the buffer cache, then reads
+   it back sequentially several times, verifying it each time.
+   Together with seq-bench-nora, which does the same with
+   read-ahead turned off, this measures what read-ahead buys:
+   compare the buffer cache hit, miss and read-ahead counts and
+   the timer ticks that each prints at shutdown. */
+
+#include "tests/filesys/base/seq-bench.inc"
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF'];
+(seq-bench) begin
+(seq-bench) create "bench"
+(seq-bench) open "bench"
+(seq-bench) writing "bench"
+(seq-bench) close "bench"
+(seq-bench) verified contents of "bench"
+(seq-bench) verified contents of "bench"
+(seq-bench) verified contents of "bench"
+(seq-bench) verified contents of "bench"
+(seq-bench) end
+EOF
+pass;
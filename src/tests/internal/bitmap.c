@@ -0,0 +1,155 @@
+/* Test program for lib/kernel/bitmap.c.
+
+   Checks bitmap_count(), bitmap_contains() and bitmap_scan()
+   against simple bit-by-bit versions on random bitmaps, then
+   measures how many CPU cycles bitmap_scan() and bitmap_count()
+   take on bitmaps of 1K to 1M bits, at several densities.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Maximum size of the bitmaps checked for correctness. */
+#define MAX_SIZE 300
+
+/* Number of times each benchmark is repeated. */
+#define BENCH_REPEAT 8
+
+static void check_bitmap (size_t bit_cnt, int density);
+static void bench_bitmap (size_t bit_cnt, int density);
+static void fill_random (struct bitmap *, int density);
+
+/* Test the bitmap implementation. */
+void
+test (void) 
+{
+  static const int densities[] = {0, 10, 50, 90, 100};
+  size_t size;
+  size_t i;
+
+  printf ("testing various size bitmaps:");
+  for (size = 0; size < MAX_SIZE; size++)
+    {
+      if (size % 20 == 0)
+        printf (" %zu", size);
+      for (i = 0; i < sizeof densities / sizeof *densities; i++)
+        check_bitmap (size, densities[i]);
+    }
+  printf (" done\n");
+
+  for (size = 1024; size <= 1024 * 1024; size *= 4)
+    for (i = 0; i < sizeof densities / sizeof *densities; i++)
+      bench_bitmap (size, densities[i]);
+
+  printf ("bitmap: PASS\n");
+}
+
+/* Bit-by-bit version of bitmap_contains(). */
+static bool
+ref_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      return true;
+  return false;
+}
+
+/* Bit-by-bit version of bitmap_scan(). */
+static size_t
+ref_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  if (cnt <= bitmap_size (b)) 
+    {
+      size_t last = bitmap_size (b) - cnt;
+      size_t i;
+      for (i = start; i <= last; i++)
+        if (!ref_contains (b, i, cnt, !value))
+          return i; 
+    }
+  return BITMAP_ERROR;
+}
+
+/* Checks the multiple-bit operations on a random BIT_CNT-bit
+   bitmap with DENSITY percent of its bits set. */
+static void
+check_bitmap (size_t bit_cnt, int density) 
+{
+  struct bitmap *b = bitmap_create (bit_cnt);
+  int repeat;
+
+  ASSERT (b != NULL);
+  fill_random (b, density);
+  for (repeat = 0; repeat < 20; repeat++) 
+    {
+      size_t start = random_ulong () % (bit_cnt + 1);
+      size_t cnt = random_ulong () % (bit_cnt - start + 1);
+      size_t scan_cnt = random_ulong () % (repeat % 2 ? 8 : bit_cnt + 2);
+      bool value = random_ulong () % 2;
+      size_t value_cnt = 0;
+      size_t i;
+
+      for (i = start; i < start + cnt; i++)
+        if (bitmap_test (b, i) == value)
+          value_cnt++;
+      ASSERT (bitmap_count (b, start, cnt, value) == value_cnt);
+      ASSERT (bitmap_contains (b, start, cnt, value)
+              == ref_contains (b, start, cnt, value));
+      ASSERT (bitmap_scan (b, start, scan_cnt, value)
+              == ref_scan (b, start, scan_cnt, value));
+
+      bitmap_set_multiple (b, start, cnt, value);
+      for (i = start; i < start + cnt; i++)
+        ASSERT (bitmap_test (b, i) == value);
+    }
+  bitmap_destroy (b);
+}
+
+/* Prints the average number of CPU cycles that a bitmap_scan()
+   for a group of 8 false bits and a bitmap_count() over the
+   whole map take on a random BIT_CNT-bit bitmap with DENSITY
+   percent of its bits set. */
+static void
+bench_bitmap (size_t bit_cnt, int density) 
+{
+  struct bitmap *b = bitmap_create (bit_cnt);
+  uint64_t scan_cycles = 0, count_cycles = 0;
+  int repeat;
+
+  ASSERT (b != NULL);
+  fill_random (b, density);
+  for (repeat = 0; repeat < BENCH_REPEAT; repeat++) 
+    {
+      uint64_t start = timer_cycles ();
+      bitmap_scan (b, 0, 8, false);
+      scan_cycles += timer_cycles () - start;
+
+      start = timer_cycles ();
+      bitmap_count (b, 0, bit_cnt, true);
+      count_cycles += timer_cycles () - start;
+    }
+  printf ("%7zu bits, %3d%% set: scan %llu cycles, count %llu cycles\n",
+          bit_cnt, density, scan_cycles / BENCH_REPEAT,
+          count_cycles / BENCH_REPEAT);
+  bitmap_destroy (b);
+}
+
+/* Sets each bit in B to true with probability DENSITY percent. */
+static void
+fill_random (struct bitmap *b, int density) 
+{
+  size_t i;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    bitmap_set (b, i, (int) (random_ulong () % 100) < density);
+}
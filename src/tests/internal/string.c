@@ -0,0 +1,179 @@
+/* Test program for memcpy(), memmove(), memset() and memcmp() in
+   lib/string.c.
+
+   Checks each function against a simple byte-at-a-time version
+   for every combination of source and destination alignment and
+   for sizes on both sides of the point where they switch to
+   word-sized string instructions, then reports how many CPU
+   cycles per KB each takes, next to the byte-at-a-time version,
+   on page-sized buffers.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Largest size to check. */
+#define MAX_SIZE 96
+
+/* Size of the benchmark buffers and number of repetitions. */
+#define BENCH_SIZE 4096
+#define BENCH_REPEAT 64
+
+static void check_all (size_t dst_ofs, size_t src_ofs, size_t size);
+static void bench (void);
+
+/* Test the memory block functions. */
+void
+test (void) 
+{
+  size_t dst_ofs, src_ofs, size;
+
+  printf ("testing various alignments and sizes:");
+  for (size = 0; size <= MAX_SIZE; size++) 
+    {
+      if (size % 16 == 0)
+        printf (" %zu", size);
+      for (dst_ofs = 0; dst_ofs < 8; dst_ofs++)
+        for (src_ofs = 0; src_ofs < 8; src_ofs++)
+          check_all (dst_ofs, src_ofs, size);
+    }
+  printf (" done\n");
+
+  bench ();
+  printf ("string: PASS\n");
+}
+
+/* Byte-at-a-time memmove(), which also serves as memcpy(). */
+static void
+byte_move (void *dst_, const void *src_, size_t size) 
+{
+  unsigned char *dst = dst_;
+  const unsigned char *src = src_;
+
+  if (dst < src) 
+    while (size-- > 0)
+      *dst++ = *src++;
+  else 
+    {
+      dst += size;
+      src += size;
+      while (size-- > 0)
+        *--dst = *--src;
+    }
+}
+
+/* Byte-at-a-time memset(). */
+static void
+byte_set (void *dst_, int value, size_t size) 
+{
+  unsigned char *dst = dst_;
+
+  while (size-- > 0)
+    *dst++ = value;
+}
+
+/* Fills the SIZE bytes at P with random data. */
+static void
+fill_random (unsigned char *p, size_t size) 
+{
+  while (size-- > 0)
+    *p++ = random_ulong ();
+}
+
+/* Returns -1, 0 or 1 as X is negative, zero or positive. */
+static int
+sign (int x) 
+{
+  return (x > 0) - (x < 0);
+}
+
+/* Checks memcpy(), memmove(), memset() and memcmp() on SIZE-byte
+   blocks at offsets DST_OFS and SRC_OFS in their buffers,
+   including overlapping moves in both directions. */
+static void
+check_all (size_t dst_ofs, size_t src_ofs, size_t size) 
+{
+  static unsigned char src[MAX_SIZE * 2 + 16], dst[sizeof src];
+  static unsigned char expect[sizeof src];
+  size_t i;
+
+  /* memcpy(). */
+  fill_random (src, sizeof src);
+  fill_random (dst, sizeof dst);
+  memcpy (expect, dst, sizeof dst);
+  byte_move (expect + dst_ofs, src + src_ofs, size);
+  ASSERT (memcpy (dst + dst_ofs, src + src_ofs, size) == dst + dst_ofs);
+  ASSERT (!memcmp (dst, expect, sizeof dst));
+
+  /* memmove() within one buffer, with the source both below and
+     above the destination. */
+  memcpy (expect, src, sizeof src);
+  byte_move (expect + dst_ofs, expect + src_ofs, size);
+  ASSERT (memmove (src + dst_ofs, src + src_ofs, size) == src + dst_ofs);
+  ASSERT (!memcmp (src, expect, sizeof src));
+
+  /* memset(). */
+  memcpy (expect, dst, sizeof dst);
+  byte_set (expect + dst_ofs, 0x100 + src_ofs, size);
+  ASSERT (memset (dst + dst_ofs, 0x100 + src_ofs, size) == dst + dst_ofs);
+  ASSERT (!memcmp (dst, expect, sizeof dst));
+
+  /* memcmp(), with at most one differing byte. */
+  fill_random (src, sizeof src);
+  memcpy (dst + dst_ofs, src + src_ofs, size);
+  ASSERT (memcmp (dst + dst_ofs, src + src_ofs, size) == 0);
+  for (i = 0; i < size; i++) 
+    {
+      unsigned char x = dst[dst_ofs + i];
+      dst[dst_ofs + i] = ~x;
+      ASSERT (sign (memcmp (src + src_ofs, dst + dst_ofs, size))
+              == sign (x - (unsigned char) ~x));
+      dst[dst_ofs + i] = x;
+    }
+}
+
+/* Keeps the result of memcmp() from being optimized away. */
+static volatile int sink;
+
+/* Prints how many cycles CALL takes per KB of BENCH_SIZE,
+   averaged over BENCH_REPEAT runs, labeled NAME. */
+#define BENCH(NAME, CALL)                                               \
+  do                                                                    \
+    {                                                                   \
+      uint64_t start = timer_cycles ();                                 \
+      int repeat;                                                       \
+      for (repeat = 0; repeat < BENCH_REPEAT; repeat++)                 \
+        CALL;                                                           \
+      printf ("%-24s %6llu cycles/KB\n", NAME,                          \
+              (timer_cycles () - start)                                 \
+              / (BENCH_REPEAT * (BENCH_SIZE / 1024)));                  \
+    }                                                                   \
+  while (0)
+
+/* Benchmarks each function and its byte-at-a-time counterpart on
+   aligned and misaligned BENCH_SIZE-byte blocks. */
+static void
+bench (void) 
+{
+  static unsigned char a[BENCH_SIZE + 8], b[BENCH_SIZE + 8];
+
+  fill_random (a, sizeof a);
+  BENCH ("memcpy aligned", memcpy (b, a, BENCH_SIZE));
+  BENCH ("memcpy misaligned", memcpy (b + 1, a + 2, BENCH_SIZE));
+  BENCH ("byte copy", byte_move (b, a, BENCH_SIZE));
+  BENCH ("memmove down", memmove (a + 4, a, BENCH_SIZE));
+  BENCH ("byte move down", byte_move (a + 4, a, BENCH_SIZE));
+  BENCH ("memset aligned", memset (b, 0, BENCH_SIZE));
+  BENCH ("memset misaligned", memset (b + 3, 0, BENCH_SIZE));
+  BENCH ("byte set", byte_set (b, 0, BENCH_SIZE));
+  memcpy (b, a, BENCH_SIZE);
+  BENCH ("memcmp equal", sink = memcmp (a, b, BENCH_SIZE));
+}
@@ -13,7 +13,10 @@
    They should receive 672, 588, 492, 408, 316, 232, 152, 92, 40,
    and 8 ticks, respectively, over 30 seconds.
 
-   (The above are computed via simulation in mlfqs.pm.) */
+   (The above are computed via simulation in mlfqs.pm.)
+
+   Each test also reports the rate of context switches while the
+   threads run, for comparing time slice policies ("-slice"). */
 
 #include <stdio.h>
 #include <inttypes.h>
@@ -67,6 +70,7 @@ test_mlfqs_fair (int thread_cnt, int nice_min, int nice_step)
 {
   struct thread_info info[MAX_THREAD_CNT];
   int64_t start_time;
+  long long start_switches;
   int nice;
   int i;
 
@@ -98,7 +102,11 @@ test_mlfqs_fair (int thread_cnt, int nice_min, int nice_step)
   msg ("Starting threads took %"PRId64" ticks.", timer_elapsed (start_time));
 
   msg ("Sleeping 40 seconds to let threads run, please wait...");
+  start_switches = thread_context_switches ();
   timer_sleep (40 * TIMER_FREQ);
+  msg ("%s time slices: %lld context switches per second.",
+       thread_slice_policy_name (),
+       (thread_context_switches () - start_switches) / 40);
   
   for (i = 0; i < thread_cnt; i++)
     msg ("Thread %d received %d ticks.", i, info[i].tick_count);
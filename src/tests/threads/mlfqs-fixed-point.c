@@ -0,0 +1,140 @@
+/* Checks that the fixed-point routines in threads/fixed-point.h
+   compute the MLFQS load_avg, recent_cpu and priority updates
+   exactly as the open-coded 64-bit divisions they replaced, and
+   reports the CPU cycles per update taken by each version. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/fixed-point.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define UPDATE_CNT 10000
+
+/* Results of one update. */
+struct update
+  {
+    int load_avg;
+    int recent_cpu;
+    int priority;
+  };
+
+/* Updates as open-coded before threads/fixed-point.h existed,
+   storing the results in *U. */
+static void
+old_update (int load_avg, int recent_cpu, int nice, int ready,
+            struct update *u)
+{
+  int co_efficient, priority;
+
+  load_avg = (((int64_t) FP_59_BY_60) * load_avg) / F + FP_1_BY_60 * ready;
+  co_efficient = (((int64_t) load_avg * 2) * F) / (load_avg * 2 + F);
+  recent_cpu = (((int64_t) co_efficient) * recent_cpu) / F + nice * F;
+  priority = ((PRI_MAX * F) - (recent_cpu / 4) - (nice * 2 * F)) / F;
+  u->load_avg = load_avg;
+  u->recent_cpu = recent_cpu;
+  u->priority = priority;
+}
+
+/* The same updates using threads/fixed-point.h, storing the
+   results in *U. */
+static void
+new_update (int load_avg, int recent_cpu, int nice, int ready,
+            struct update *u)
+{
+  int co_efficient, priority;
+
+  load_avg = fp_mul (FP_59_BY_60, load_avg) + FP_1_BY_60 * ready;
+  co_efficient = fp_div (load_avg * 2, load_avg * 2 + F);
+  recent_cpu = fp_mul (co_efficient, recent_cpu) + fp_from_int (nice);
+  priority = fp_to_int (fp_from_int (PRI_MAX - nice * 2)
+                        - fp_div_pow2 (recent_cpu, 2));
+  u->load_avg = load_avg;
+  u->recent_cpu = recent_cpu;
+  u->priority = priority;
+}
+
+/* Returns a checksum of U, to keep the timed updates from being
+   optimized away. */
+static int
+checksum (const struct update *u)
+{
+  return u->load_avg + u->recent_cpu + u->priority;
+}
+
+/* Returns the inputs for update I. */
+static void
+get_inputs (int i, int *load_avg, int *recent_cpu, int *nice, int *ready)
+{
+  *load_avg = (i * 97) % (64 * F);
+  *recent_cpu = (i * 7919) % (200 * F) - 20 * F;
+  *nice = i % 41 - 20;
+  *ready = i % 64;
+}
+
+void
+test_mlfqs_fixed_point (void) 
+{
+  enum intr_level old_level;
+  uint64_t start, old_cycles, new_cycles;
+  int i, sum;
+
+  for (i = 0; i < UPDATE_CNT; i++)
+    {
+      int load_avg, recent_cpu, nice, ready;
+      struct update old, new;
+
+      get_inputs (i, &load_avg, &recent_cpu, &nice, &ready);
+      old_update (load_avg, recent_cpu, nice, ready, &old);
+      new_update (load_avg, recent_cpu, nice, ready, &new);
+      if (old.load_avg != new.load_avg)
+        fail ("load_avg differs for load_avg %d, ready %d: %d vs. %d",
+              load_avg, ready, old.load_avg, new.load_avg);
+      if (old.recent_cpu != new.recent_cpu)
+        fail ("recent_cpu differs for load_avg %d, recent_cpu %d, nice %d: "
+              "%d vs. %d", load_avg, recent_cpu, nice,
+              old.recent_cpu, new.recent_cpu);
+      if (old.priority != new.priority)
+        fail ("priority differs for load_avg %d, recent_cpu %d, nice %d: "
+              "%d vs. %d", load_avg, recent_cpu, nice,
+              old.priority, new.priority);
+    }
+  msg ("%d updates give identical results.", UPDATE_CNT);
+
+  /* Time each version with interrupts off so that timer
+     interrupts do not add noise. */
+  old_level = intr_disable ();
+  sum = 0;
+  start = timer_cycles ();
+  for (i = 0; i < UPDATE_CNT; i++)
+    {
+      int load_avg, recent_cpu, nice, ready;
+      struct update u;
+
+      get_inputs (i, &load_avg, &recent_cpu, &nice, &ready);
+      old_update (load_avg, recent_cpu, nice, ready, &u);
+      sum += checksum (&u);
+    }
+  old_cycles = timer_cycles () - start;
+
+  start = timer_cycles ();
+  for (i = 0; i < UPDATE_CNT; i++)
+    {
+      int load_avg, recent_cpu, nice, ready;
+      struct update u;
+
+      get_inputs (i, &load_avg, &recent_cpu, &nice, &ready);
+      new_update (load_avg, recent_cpu, nice, ready, &u);
+      sum -= checksum (&u);
+    }
+  new_cycles = timer_cycles () - start;
+  intr_set_level (old_level);
+
+  if (sum != 0)
+    fail ("checksums differ");
+  msg ("Open-coded: %llu cycles per update.", old_cycles / UPDATE_CNT);
+  msg ("fixed-point.h: %llu cycles per update.", new_cycles / UPDATE_CNT);
+
+  pass ();
+}
@@ -4,7 +4,9 @@
    perl -e '$i++,$a=(59*$a+1)/60while$a<=.5;print "$i\n"'
 
    Then, verifies that 10 seconds of inactivity drop the load
-   average back below 0.5 again. */
+   average back below 0.5 again.  Also reports the rate of context
+   switches over the whole run, for comparing time slice policies
+   ("-slice"). */
 
 #include <stdio.h>
 #include "tests/threads/tests.h"
@@ -18,6 +20,7 @@ void
 test_mlfqs_load_1 (void) 
 {
   int64_t start_time;
+  long long start_switches;
   int elapsed;
   int load_avg;
   
@@ -26,6 +29,7 @@ test_mlfqs_load_1 (void)
   msg ("spinning for up to 45 seconds, please wait...");
 
   start_time = timer_ticks ();
+  start_switches = thread_context_switches ();
   for (;;) 
     {
       load_avg = thread_get_load_avg ();
@@ -55,6 +59,10 @@ test_mlfqs_load_1 (void)
     fail ("load average stayed above 0.5 for more than 10 seconds");
   msg ("load average fell back below 0.5 (to %d.%02d)",
        load_avg / 100, load_avg % 100);
+  msg ("%s time slices: %lld context switches per second.",
+       thread_slice_policy_name (),
+       (thread_context_switches () - start_switches) * TIMER_FREQ
+       / timer_elapsed (start_time));
 
   pass ();
 }
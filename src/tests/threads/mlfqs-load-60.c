@@ -1,7 +1,9 @@
 /* Starts 60 threads that each sleep for 10 seconds, then spin in
    a tight loop for 60 seconds, and sleep for another 60 seconds.
    Every 2 seconds after the initial sleep, the main thread
-   prints the load average.
+   prints the load average.  After the spinning minute, it also
+   reports the rate of context switches during it, for comparing
+   time slice policies ("-slice").
 
    The expected output is this (some margin of error is allowed):
 
@@ -114,6 +116,7 @@ static void load_thread (void *aux);
 void
 test_mlfqs_load_60 (void) 
 {
+  long long start_switches = 0;
   int i;
   
   ASSERT (thread_mlfqs);
@@ -137,6 +140,14 @@ test_mlfqs_load_60 (void)
       load_avg = thread_get_load_avg ();
       msg ("After %d seconds, load average=%d.%02d.",
            i * 2, load_avg / 100, load_avg % 100);
+
+      /* Report the switch rate while the load threads spin. */
+      if (i == 0)
+        start_switches = thread_context_switches ();
+      else if (i == 30)
+        msg ("%s time slices: %lld context switches per second.",
+             thread_slice_policy_name (),
+             (thread_context_switches () - start_switches) / 60);
     }
 }
 
@@ -0,0 +1,74 @@
+/* Measures the worst-case time spent in the timer interrupt
+   handler while many threads exist.
+
+   Creates THREAD_CNT threads that block on a semaphore, so that
+   every one of them needs its recent_cpu decayed and its
+   priority recomputed each second, then spins for a few seconds
+   and reports the largest number of CPU cycles any single timer
+   interrupt took.  Run against different kernels to compare;
+   the figure should not grow with THREAD_CNT. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 100
+#define SPIN_SECONDS 3
+
+/* Semaphores shared with the blocked threads. */
+struct latency_sync
+  {
+    struct semaphore start;     /* Upped to let a thread exit. */
+    struct semaphore done;      /* Upped by each thread as it exits. */
+  };
+
+static void block_thread (void *sync_);
+
+void
+test_mlfqs_timer_latency (void) 
+{
+  struct latency_sync sync;
+  int64_t start_time;
+  int i;
+
+  ASSERT (thread_mlfqs);
+
+  sema_init (&sync.start, 0);
+  sema_init (&sync.done, 0);
+
+  msg ("Creating %d blocked threads...", THREAD_CNT);
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "block %d", i);
+      thread_create (name, PRI_DEFAULT, block_thread, &sync);
+    }
+
+  msg ("Spinning for %d seconds...", SPIN_SECONDS);
+  start_time = timer_ticks ();
+  while (timer_elapsed (start_time) < SPIN_SECONDS * TIMER_FREQ)
+    continue;
+
+  msg ("Worst-case timer interrupt: %llu cycles with %d threads.",
+       timer_max_interrupt_cycles (), THREAD_CNT);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_up (&sync.start);
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&sync.done);
+
+  pass ();
+}
+
+static void
+block_thread (void *sync_) 
+{
+  struct latency_sync *sync = sync_;
+
+  sema_down (&sync->start);
+  sema_up (&sync->done);
+}
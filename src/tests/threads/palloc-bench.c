@@ -0,0 +1,107 @@
+/* Measures how long palloc_get_multiple() takes as the user pool
+   fills up.
+
+   Fills the user pool to 10%, 50% and 90% occupancy with single
+   pages chosen at random, so that the free space is fragmented,
+   then times ITER_CNT allocations of 1, 2, 4 and 8 pages at each
+   level, freeing each one right after, and reports the average
+   number of CPU cycles per allocation and how many failed.  Run
+   against kernels built with PALLOC=buddy and PALLOC=bitmap to
+   compare. */
+
+#include <stdio.h>
+#include <random.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "devices/timer.h"
+
+#define ITER_CNT 1000
+
+static void measure (void **pages, size_t page_cnt, int percent);
+
+void
+test_palloc_bench (void) 
+{
+  static const int percents[] = {10, 50, 90};
+  void **pages;
+  size_t page_cnt;
+  void *page;
+  void *chain = NULL;
+  size_t i;
+
+  /* Count the pages in the user pool by taking all of them,
+     chaining them through their first word. */
+  page_cnt = 0;
+  while ((page = palloc_get_page (PAL_USER)) != NULL)
+    {
+      *(void **) page = chain;
+      chain = page;
+      page_cnt++;
+    }
+  msg ("User pool has %zu pages.", page_cnt);
+
+  pages = malloc (page_cnt * sizeof *pages);
+  if (pages == NULL)
+    fail ("couldn't allocate page array");
+  for (i = 0; i < page_cnt; i++)
+    {
+      pages[i] = chain;
+      chain = *(void **) chain;
+    }
+
+  for (i = 0; i < sizeof percents / sizeof *percents; i++)
+    measure (pages, page_cnt, percents[i]);
+
+  free (pages);
+  pass ();
+}
+
+/* Frees pages at random from PAGES[], which holds all PAGE_CNT
+   pages of the user pool, until PERCENT% of them remain, times
+   allocations at that occupancy, then takes the freed pages back
+   so that PAGES[] holds the whole pool again. */
+static void
+measure (void **pages, size_t page_cnt, int percent) 
+{
+  size_t keep_cnt = page_cnt * percent / 100;
+  uint64_t cycles[4] = {0, 0, 0, 0};
+  int failures[4] = {0, 0, 0, 0};
+  size_t i;
+  int j;
+
+  /* Shuffle PAGES[] and free everything past KEEP_CNT. */
+  random_init (percent);
+  for (i = page_cnt; i > 1; i--)
+    {
+      size_t k = random_ulong () % i;
+      void *t = pages[i - 1];
+      pages[i - 1] = pages[k];
+      pages[k] = t;
+    }
+  for (i = keep_cnt; i < page_cnt; i++)
+    palloc_free_page (pages[i]);
+
+  for (i = 0; i < ITER_CNT; i++)
+    for (j = 0; j < 4; j++)
+      {
+        uint64_t start = timer_cycles ();
+        void *p = palloc_get_multiple (PAL_USER, 1 << j);
+        cycles[j] += timer_cycles () - start;
+        if (p != NULL)
+          palloc_free_multiple (p, 1 << j);
+        else
+          failures[j]++;
+      }
+
+  for (j = 0; j < 4; j++)
+    msg ("%d%% full, %d pages: %llu cycles per allocation, %d failed.",
+         percent, 1 << j, cycles[j] / ITER_CNT, failures[j]);
+
+  /* Fill the pool again. */
+  for (i = keep_cnt; i < page_cnt; i++)
+    {
+      pages[i] = palloc_get_page (PAL_USER);
+      ASSERT (pages[i] != NULL);
+    }
+}
@@ -0,0 +1,97 @@
+/* Stresses priority donation with many waiters and deep nesting.
+
+   The main thread sets its priority to PRI_MIN and acquires
+   lock 0.  It then creates CHAIN_DEPTH - 1 "chain" threads, each
+   of which acquires lock[i] and then blocks trying to acquire
+   lock[i - 1], so that the locks form a chain CHAIN_DEPTH deep
+   that ends at the main thread.
+
+   Next it creates WAITER_CNT "waiter" threads in order of
+   nondecreasing priority, each blocking on one of the locks.
+   Every donation must travel down the chain to the main thread,
+   whose priority must always equal the highest waiter priority
+   so far.
+
+   Finally the main thread releases lock 0 and drops back to
+   PRI_MIN.  Every other thread must then run to completion
+   before it runs again. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define CHAIN_DEPTH 50
+#define WAITER_CNT 1000
+
+static struct lock locks[CHAIN_DEPTH];
+static int done_cnt;
+
+static thread_func chain_thread_func;
+static thread_func waiter_thread_func;
+
+void
+test_priority_donate_stress (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  thread_set_priority (PRI_MIN);
+
+  for (i = 0; i < CHAIN_DEPTH; i++)
+    lock_init (&locks[i]);
+  done_cnt = 0;
+
+  lock_acquire (&locks[0]);
+  for (i = 1; i < CHAIN_DEPTH; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "chain %d", i);
+      thread_create (name, PRI_MIN + 1, chain_thread_func, &locks[i]);
+    }
+  msg ("Created %d chain threads.", CHAIN_DEPTH - 1);
+
+  for (i = 0; i < WAITER_CNT; i++) 
+    {
+      int priority = PRI_MIN + 2 + i * (PRI_MAX - PRI_MIN - 2) / WAITER_CNT;
+      char name[16];
+
+      snprintf (name, sizeof name, "waiter %d", i);
+      thread_create (name, priority, waiter_thread_func,
+                     &locks[i % CHAIN_DEPTH]);
+      if (thread_get_priority () != priority)
+        fail ("after creating waiter %d, main thread has priority %d, "
+              "but should have %d", i, thread_get_priority (), priority);
+    }
+  msg ("Created %d waiter threads.", WAITER_CNT);
+
+  lock_release (&locks[0]);
+  msg ("Main thread has priority %d.", thread_get_priority ());
+  msg ("%d of %d threads finished.",
+       done_cnt, CHAIN_DEPTH - 1 + WAITER_CNT);
+}
+
+static void
+chain_thread_func (void *lock_) 
+{
+  struct lock *lock = lock_;
+
+  lock_acquire (lock);
+  lock_acquire (lock - 1);
+  lock_release (lock - 1);
+  lock_release (lock);
+  done_cnt++;
+}
+
+static void
+waiter_thread_func (void *lock_) 
+{
+  struct lock *lock = lock_;
+
+  lock_acquire (lock);
+  lock_release (lock);
+  done_cnt++;
+}
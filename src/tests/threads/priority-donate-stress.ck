@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-stress) begin
+(priority-donate-stress) Created 49 chain threads.
+(priority-donate-stress) Created 1000 waiter threads.
+(priority-donate-stress) Main thread has priority 0.
+(priority-donate-stress) 1049 of 1049 threads finished.
+(priority-donate-stress) end
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Measures how fast the kernel sweeps through a large block of
+   RAM, which mostly measures how often it misses the TLB.
+
+   Takes up to SWEEP_PAGES contiguous pages from the user pool,
+   through their kernel virtual addresses, then times PASS_CNT
+   passes that read one word from every page, and PASS_CNT passes
+   that memcpy() the first half of the block onto the second.
+   Reports the average number of CPU cycles per page for each.
+   The word-per-page sweep touches a new page on every access,
+   so with 4 kB pages it takes a TLB miss nearly every time,
+   while with 4 MB pages the whole block fits in a few TLB
+   entries. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define SWEEP_PAGES 2048
+#define PASS_CNT 16
+
+void
+test_tlb_sweep (void) 
+{
+  size_t page_cnt, half;
+  uint8_t *block;
+  uint64_t start, cycles;
+  volatile uint32_t sum = 0;
+  int p;
+  size_t i;
+
+  msg ("Kernel RAM mapped with %s pages.",
+       init_large_pages ? "4 MB" : "4 kB");
+
+  for (page_cnt = SWEEP_PAGES; page_cnt >= 2; page_cnt /= 2)
+    {
+      block = palloc_get_multiple (PAL_USER | PAL_ZERO, page_cnt);
+      if (block != NULL)
+        break;
+    }
+  if (page_cnt < 2)
+    fail ("couldn't allocate pages to sweep");
+  msg ("Sweeping %zu pages.", page_cnt);
+
+  start = timer_cycles ();
+  for (p = 0; p < PASS_CNT; p++)
+    for (i = 0; i < page_cnt; i++)
+      sum += *(uint32_t *) (block + i * PGSIZE);
+  cycles = timer_cycles () - start;
+  msg ("Word per page: %llu cycles per page.",
+       cycles / (PASS_CNT * page_cnt));
+
+  half = page_cnt / 2 * PGSIZE;
+  start = timer_cycles ();
+  for (p = 0; p < PASS_CNT; p++)
+    memcpy (block + half, block, half);
+  cycles = timer_cycles () - start;
+  msg ("memcpy: %llu cycles per page.",
+       cycles / (PASS_CNT * (page_cnt / 2)));
+
+  palloc_free_multiple (block, page_cnt);
+  pass ();
+}
@@ -0,0 +1,74 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* 17.14 fixed-point arithmetic, used by the multi-level feedback
+   queue scheduler.
+
+   A fixed-point value is an int whose low FP_SHIFT bits are the
+   fraction, so the real number x is represented as x * F.  All
+   operations truncate toward zero, like C integer division, so
+   that results do not depend on whether the compiler uses a
+   shift or a divide.  Division by F and by other powers of two
+   is done with fp_div_pow2(), which is a shift plus a sign
+   correction; only division by a run-time value needs a real
+   (64-bit) divide. */
+
+#define FP_SHIFT 14                     /* # of fraction bits. */
+#define F (1 << FP_SHIFT)               /* 1.0 in fixed point. */
+#define F_BY_2 (F / 2)                  /* 0.5 in fixed point. */
+#define FP_59_BY_60 16111               /* 59/60 in fixed point. */
+#define FP_1_BY_60 273                  /* 1/60 in fixed point. */
+
+/* Returns X / 2**SHIFT, rounded toward zero, for a compile-time
+   constant SHIFT. */
+static inline int
+fp_div_pow2 (int x, int shift)
+{
+  return (x + ((x >> 31) & ((1 << shift) - 1))) >> shift;
+}
+
+/* 64-bit version of fp_div_pow2(), for products. */
+static inline int
+fp_div_pow2_64 (int64_t x, int shift)
+{
+  return (x + ((x >> 63) & ((1 << shift) - 1))) >> shift;
+}
+
+/* Converts integer N to fixed point. */
+static inline int
+fp_from_int (int n)
+{
+  return n * F;
+}
+
+/* Converts fixed-point X to an integer, rounding toward zero. */
+static inline int
+fp_to_int (int x)
+{
+  return fp_div_pow2 (x, FP_SHIFT);
+}
+
+/* Converts fixed-point X to an integer, rounding to nearest. */
+static inline int
+fp_to_int_nearest (int x)
+{
+  return x >= 0 ? fp_to_int (x + F_BY_2) : fp_to_int (x - F_BY_2);
+}
+
+/* Returns fixed-point X times fixed-point Y. */
+static inline int
+fp_mul (int x, int y)
+{
+  return fp_div_pow2_64 ((int64_t) x * y, FP_SHIFT);
+}
+
+/* Returns fixed-point X divided by fixed-point Y. */
+static inline int
+fp_div (int x, int y)
+{
+  return ((int64_t) x << FP_SHIFT) / y;
+}
+
+#endif /* threads/fixed-point.h */
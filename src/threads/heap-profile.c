@@ -0,0 +1,239 @@
+#include "threads/heap-profile.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+
+#ifdef HEAP_PROFILE
+/* Both tables below are fixed-size hash tables with linear
+   probing, so that the profiler never allocates memory itself.
+   They are accessed only with interrupts off. */
+
+/* Number of call sites tracked. */
+#define SITE_BITS 8
+#define SITE_CNT (1 << SITE_BITS)
+
+/* Number of live allocations tracked. */
+#define BLOCK_BITS 12
+#define BLOCK_CNT (1 << BLOCK_BITS)
+
+/* Number of sites printed by heap_profile_print(). */
+#define TOP_CNT 10
+
+/* Statistics for one call site. */
+struct site
+  {
+    const void *addr;           /* Return address; null if unused. */
+    enum heap_profile_kind kind; /* Allocator called. */
+    size_t live_bytes;          /* Bytes currently allocated. */
+    size_t peak_bytes;          /* Maximum of live_bytes. */
+    unsigned live_cnt;          /* Allocations not yet freed. */
+    unsigned alloc_cnt;         /* Total allocations. */
+    unsigned free_cnt;          /* Total frees. */
+  };
+
+/* A live allocation. */
+struct block
+  {
+    void *ptr;                  /* Address; null if unused. */
+    size_t size;                /* Size in bytes. */
+    struct site *site;          /* Site that allocated it. */
+  };
+
+static struct site sites[SITE_CNT];
+static struct block blocks[BLOCK_CNT];
+
+/* Allocations we could not track because a table was full. */
+static unsigned dropped_cnt;
+
+/* Returns a BITS-bit hash of pointer P. */
+static inline size_t
+hash_ptr (const void *p, int bits)
+{
+  return (uint32_t) ((uintptr_t) p * 2654435761u) >> (32 - bits);
+}
+
+/* Returns the statistics for call site ADDR, adding them if
+   necessary, or a null pointer if the table is full. */
+static struct site *
+find_site (const void *addr, enum heap_profile_kind kind)
+{
+  size_t i = hash_ptr (addr, SITE_BITS);
+  size_t n;
+
+  for (n = 0; n < SITE_CNT; n++, i = (i + 1) % SITE_CNT)
+    {
+      struct site *s = &sites[i];
+      if (s->addr == addr)
+        return s;
+      if (s->addr == NULL)
+        {
+          s->addr = addr;
+          s->kind = kind;
+          return s;
+        }
+    }
+  return NULL;
+}
+
+/* Returns the slot in blocks[] that holds PTR, or the empty slot
+   where it would go if it is not there, or a null pointer if it
+   is not there and the table is full. */
+static struct block *
+find_block (const void *ptr)
+{
+  size_t i = hash_ptr (ptr, BLOCK_BITS);
+  size_t n;
+
+  for (n = 0; n < BLOCK_CNT; n++, i = (i + 1) % BLOCK_CNT)
+    if (blocks[i].ptr == ptr || blocks[i].ptr == NULL)
+      return &blocks[i];
+  return NULL;
+}
+
+/* Empties slot B of blocks[], moving later entries of the same
+   probe sequence back so that lookups still find them. */
+static void
+remove_block (struct block *b)
+{
+  size_t hole = b - blocks;
+  size_t i = hole;
+
+  for (;;)
+    {
+      size_t home;
+
+      i = (i + 1) % BLOCK_CNT;
+      if (blocks[i].ptr == NULL)
+        break;
+
+      /* The entry at I can fill the hole unless its home slot
+         lies cyclically in (HOLE, I]. */
+      home = hash_ptr (blocks[i].ptr, BLOCK_BITS);
+      if ((i > hole && (home <= hole || home > i))
+          || (i < hole && home <= hole && home > i))
+        {
+          blocks[hole] = blocks[i];
+          hole = i;
+        }
+    }
+  blocks[hole].ptr = NULL;
+}
+
+/* Records that SITE, calling into allocator KIND, obtained SIZE
+   bytes at PTR.  Does nothing if PTR is null. */
+void
+heap_profile_alloc (void *ptr, size_t size, const void *site,
+                    enum heap_profile_kind kind)
+{
+  enum intr_level old_level;
+  struct site *s;
+  struct block *b;
+
+  if (ptr == NULL)
+    return;
+
+  old_level = intr_disable ();
+  s = find_site (site, kind);
+  b = find_block (ptr);
+  if (s != NULL && b != NULL && b->ptr == NULL)
+    {
+      b->ptr = ptr;
+      b->size = size;
+      b->site = s;
+      s->alloc_cnt++;
+      s->live_cnt++;
+      s->live_bytes += size;
+      if (s->live_bytes > s->peak_bytes)
+        s->peak_bytes = s->live_bytes;
+    }
+  else
+    dropped_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Records that PTR was freed.  Does nothing if PTR is null or
+   its allocation was not recorded. */
+void
+heap_profile_free (void *ptr)
+{
+  enum intr_level old_level;
+  struct block *b;
+
+  if (ptr == NULL)
+    return;
+
+  old_level = intr_disable ();
+  b = find_block (ptr);
+  if (b != NULL && b->ptr != NULL)
+    {
+      struct site *s = b->site;
+      s->free_cnt++;
+      s->live_cnt--;
+      s->live_bytes -= b->size;
+      remove_block (b);
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that the allocation at PTR now holds SIZE bytes, as
+   after resizing it in place.  Does nothing if PTR is null or its
+   allocation was not recorded. */
+void
+heap_profile_resize (void *ptr, size_t size)
+{
+  enum intr_level old_level;
+  struct block *b;
+
+  if (ptr == NULL)
+    return;
+
+  old_level = intr_disable ();
+  b = find_block (ptr);
+  if (b != NULL && b->ptr != NULL)
+    {
+      struct site *s = b->site;
+      s->live_bytes += size - b->size;
+      if (s->live_bytes > s->peak_bytes)
+        s->peak_bytes = s->live_bytes;
+      b->size = size;
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints the TOP_CNT call sites with the most live bytes. */
+void
+heap_profile_print (void)
+{
+  static bool printed[SITE_CNT];
+  enum intr_level old_level = intr_disable ();
+  int n;
+
+  printf ("Heap profile: top call sites by live bytes "
+          "(symbolize with utils/backtrace):\n");
+  for (n = 0; n < SITE_CNT; n++)
+    printed[n] = false;
+  for (n = 0; n < TOP_CNT; n++)
+    {
+      struct site *best = NULL;
+      size_t i;
+
+      for (i = 0; i < SITE_CNT; i++)
+        if (sites[i].addr != NULL && !printed[i]
+            && (best == NULL || sites[i].live_bytes > best->live_bytes))
+          best = &sites[i];
+      if (best == NULL)
+        break;
+      printed[best - sites] = true;
+
+      printf ("  %p %s: %zu bytes in %u blocks live, %zu peak, "
+              "%u allocs, %u frees\n",
+              best->addr, best->kind == HEAP_MALLOC ? "malloc" : "palloc",
+              best->live_bytes, best->live_cnt, best->peak_bytes,
+              best->alloc_cnt, best->free_cnt);
+    }
+  if (dropped_cnt > 0)
+    printf ("  (%u allocations not tracked: tables full)\n", dropped_cnt);
+  intr_set_level (old_level);
+}
+#endif /* HEAP_PROFILE */
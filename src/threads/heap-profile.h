@@ -0,0 +1,30 @@
+#ifndef THREADS_HEAP_PROFILE_H
+#define THREADS_HEAP_PROFILE_H
+
+#include <stddef.h>
+
+/* Heap profiler.
+
+   In kernels built with HEAP_PROFILE=1 (which defines
+   HEAP_PROFILE), malloc() and friends and palloc_get_multiple()
+   and palloc_free_multiple() report every allocation and free
+   here, along with the return address of their caller.  The
+   profiler totals live bytes, peak live bytes and allocation
+   counts per call site, and heap_profile_print() lists the sites
+   holding the most memory.  Feed the addresses it prints to
+   utils/backtrace to turn them into function names. */
+
+/* Allocator that an allocation came from. */
+enum heap_profile_kind
+  {
+    HEAP_MALLOC,                /* malloc(), calloc(), realloc(). */
+    HEAP_PALLOC                 /* palloc_get_page/multiple(). */
+  };
+
+void heap_profile_alloc (void *, size_t size, const void *site,
+                         enum heap_profile_kind);
+void heap_profile_free (void *);
+void heap_profile_resize (void *, size_t size);
+void heap_profile_print (void);
+
+#endif /* threads/heap-profile.h */
@@ -15,6 +15,8 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/flags.h"
+#include "threads/heap-profile.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -36,11 +38,22 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* True if kernel RAM is mapped with 4 MB pages. */
+bool init_large_pages;
+
+/* CR4 bits for page size extensions and global pages, and the
+   CPUID feature bits that say they are there. */
+#define CR4_PSE 0x00000010
+#define CR4_PGE 0x00000080
+#define CPUID_PSE 0x00000008
+#define CPUID_PGE 0x00002000
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -59,6 +72,7 @@ static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
 static void paging_init (void);
+static uint32_t cpu_features (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -154,16 +168,48 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports page size extensions, each 4 MB of RAM
+   that does not overlap the kernel text, which has to stay
+   read-only, is mapped with a single 4 MB page.  This saves a
+   page table per 4 MB and lets one TLB entry cover what would
+   otherwise take 1,024.  Page directories made by
+   pagedir_create() copy these entries along with the rest of
+   the kernel mapping.
+
+   If the CPU supports global pages, the kernel mapping is also
+   marked global.  It is the same in every page directory, so
+   its TLB entries can survive the CR3 reload on each process
+   switch; only user translations get flushed. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
+  uint32_t features, cr4, global;
   size_t page;
   extern char _start, _end_kernel_text;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
+
+  /* Turn on page size extensions and global pages if we have
+     them.  See [IA32-v3a] 2.5 "Control Registers". */
+  features = cpu_features ();
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (features & CPUID_PSE)
+    {
+      cr4 |= CR4_PSE;
+      init_large_pages = true;
+    }
+  global = 0;
+  if (features & CPUID_PGE)
+    {
+      cr4 |= CR4_PGE;
+      global = PTE_G;
+    }
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+
   for (page = 0; page < init_ram_pages; page++)
     {
       uintptr_t paddr = page * PGSIZE;
@@ -172,13 +218,22 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (init_large_pages && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true) | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -189,6 +244,33 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Returns the feature flags that the CPUID instruction reports
+   in EDX, or 0 for CPUs too old to have CPUID, which we detect by
+   EFLAGS.ID refusing to change.  See [IA32-v2a] "CPUID--CPU
+   Identification". */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t before, after, eax, ebx, ecx, edx;
+
+  asm volatile ("pushfl; popl %0; movl %0, %1; xorl %2, %1;"
+                "pushl %1; popfl; pushfl; popl %1; pushl %0; popfl"
+                : "=&r" (before), "=&r" (after) : "i" (FLAG_ID));
+  if (((before ^ after) & FLAG_ID) == 0)
+    return 0;
+
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (0));
+  if (eax < 1)
+    return 0;
+
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (1));
+  return edx;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -248,6 +330,8 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-ra"))
+        inode_readahead_max = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -257,6 +341,20 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-slice"))
+        {
+          if (value != NULL && !strcmp (value, "fixed"))
+            thread_slice_policy = SLICE_FIXED;
+          else if (value != NULL && !strcmp (value, "adaptive"))
+            thread_slice_policy = SLICE_ADAPTIVE;
+          else
+            PANIC ("unknown time slice policy `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
+      else if (!strcmp (name, "-tcache"))
+        thread_cache_max = atoi (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -293,6 +391,22 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+/* Prints per-thread scheduler statistics. */
+static void
+run_sched_stats (char **argv UNUSED)
+{
+  thread_print_sched_stats ();
+}
+
+#ifdef HEAP_PROFILE
+/* Prints the call sites holding the most heap memory. */
+static void
+run_heap_profile (char **argv UNUSED)
+{
+  heap_profile_print ();
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -310,6 +424,10 @@ run_actions (char **argv)
   static const struct action actions[] = 
     {
       {"run", 2, run_task},
+      {"sched-stats", 1, run_sched_stats},
+#ifdef HEAP_PROFILE
+      {"heap-profile", 1, run_heap_profile},
+#endif
 #ifdef FILESYS
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
@@ -357,6 +475,10 @@ usage (void)
           "  run 'PROG [ARG...]' Run PROG and wait for it to complete.\n"
 #else
           "  run TEST           Run TEST.\n"
+#endif
+          "  sched-stats        Print per-thread scheduler statistics.\n"
+#ifdef HEAP_PROFILE
+          "  heap-profile       Print the call sites holding the most heap.\n"
 #endif
 #ifdef FILESYS
           "  ls                 List files in the root directory.\n"
@@ -374,12 +496,16 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -ra=SECTORS        Read ahead up to SECTORS sectors (default 16).\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the timer interrupt while idle.\n"
+          "  -slice=POLICY      Time slice policy: fixed (default) or adaptive.\n"
+          "  -tcache=COUNT      Keep up to COUNT free thread pages (default 16).\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/heap-profile.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -28,19 +30,77 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   In front of each descriptor sits a "magazine", a small stack
+   of blocks that were freed recently and have not gone back to
+   the free list.  malloc() and free() try the magazine first,
+   with interrupts disabled instead of the descriptor's lock, so
+   that allocation churn within a size class usually doesn't
+   touch the free list or the arenas at all.  Blocks in a
+   magazine still count as in use in their arenas.
+
+   An arena that becomes unused is not released immediately:
+   each descriptor with single-page arenas keeps up to
+   ARENA_SPARE_CNT of them, so that alloc/free churn across an
+   arena boundary doesn't bounce pages to and from the page
+   allocator.
+
+   Blocks of 2 kB and up don't fit in a single page with a
+   descriptor.  Up to 16 kB, "medium" descriptors handle them the
+   same way, but with arenas of up to MEDIUM_ARENA_PAGES pages,
+   sized to waste as little of them as possible.  Their arenas
+   are freed as soon as they become unused.  Since such a
+   block need not lie in its arena's first page, each one is
+   preceded by a pointer to its arena.  Medium blocks are 16-byte
+   aligned, and other blocks never are, which is how free() tells
+   them apart.
+
+   We handle blocks bigger than 16 kB by allocating contiguous
+   pages with the page allocator and sticking the allocation size
+   at the beginning of the allocated block's arena header.
+   realloc() resizes such a block in place when it can, by
+   freeing pages off its end or taking the free pages after it. */
+
+/* Number of blocks a magazine holds, for small and medium
+   blocks. */
+#define MAGAZINE_SIZE 16
+#define MEDIUM_MAGAZINE_SIZE 2
+
+/* Alignment of medium blocks, and size of the header in front of
+   each one. */
+#define MEDIUM_ALIGN 16
+
+/* Maximum number of pages in a medium arena.  Larger arenas
+   waste less space, but each one needs that many contiguous
+   pages. */
+#define MEDIUM_ARENA_PAGES 8
+
+/* Number of unused single-page arenas a descriptor keeps. */
+#define ARENA_SPARE_CNT 1
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    bool medium;                /* Medium block layout? */
+    size_t arena_pages;         /* Number of pages in an arena. */
+    size_t block_ofs;           /* Offset of first block in arena. */
+    size_t block_stride;        /* Distance between blocks in arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    size_t spare_cnt;           /* Number of unused arenas kept. */
+    size_t spare_max;           /* Maximum value of spare_cnt. */
+
+    /* Magazine.  Accessed only with interrupts off. */
+    void *magazine[MAGAZINE_SIZE]; /* Cached blocks. */
+    size_t magazine_cnt;        /* Number of blocks in magazine. */
+    size_t magazine_max;        /* Capacity of magazine. */
+
+    /* Statistics. */
+    long long hit_cnt;          /* Allocations served by magazine. */
+    long long miss_cnt;         /* Allocations from the free list. */
+    long long arena_alloc_cnt;  /* Arenas obtained from palloc. */
+    long long arena_free_cnt;   /* Arenas returned to palloc. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -61,37 +121,175 @@ struct block
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[16];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static bool resize_big_block (struct arena *, size_t new_size);
+static void *allocate (size_t size);
+static void *resize (void *old_block, size_t new_size);
+static void release (void *p);
+
+/* Adds a descriptor for BLOCK_SIZE-byte blocks and returns it. */
+static struct desc *
+add_desc (size_t block_size) 
+{
+  struct desc *d = &descs[desc_cnt++];
+
+  ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+  d->block_size = block_size;
+  list_init (&d->free_list);
+  lock_init (&d->lock);
+  d->spare_cnt = 0;
+  d->magazine_cnt = 0;
+  d->hit_cnt = d->miss_cnt = 0;
+  d->arena_alloc_cnt = d->arena_free_cnt = 0;
+  return d;
+}
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
+  static const size_t medium_sizes[] =
+    {2048, 3072, 4096, 6144, 8192, 12288, 16384};
   size_t block_size;
+  size_t i;
+
+  /* Small blocks are never MEDIUM_ALIGN-aligned. */
+  ASSERT (sizeof (struct arena) % MEDIUM_ALIGN != 0);
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
-      struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
+      struct desc *d = add_desc (block_size);
+      d->medium = false;
+      d->arena_pages = 1;
+      d->block_ofs = sizeof (struct arena);
+      d->block_stride = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      d->spare_max = ARENA_SPARE_CNT;
+      d->magazine_max = MAGAZINE_SIZE;
     }
+
+  for (i = 0; i < sizeof medium_sizes / sizeof *medium_sizes; i++)
+    {
+      struct desc *d = add_desc (medium_sizes[i]);
+      size_t pages;
+
+      d->medium = true;
+      d->block_ofs = 2 * MEDIUM_ALIGN;
+      d->block_stride = medium_sizes[i] + MEDIUM_ALIGN;
+      d->blocks_per_arena = 0;
+
+      /* Use the arena size that puts the largest fraction of its
+         pages into blocks, preferring fewer pages on a tie. */
+      for (pages = 1; pages <= MEDIUM_ARENA_PAGES; pages++)
+        {
+          size_t blocks = (pages * PGSIZE - MEDIUM_ALIGN) / d->block_stride;
+          if (blocks > 0
+              && (d->blocks_per_arena == 0
+                  || blocks * d->arena_pages > d->blocks_per_arena * pages))
+            {
+              d->arena_pages = pages;
+              d->blocks_per_arena = blocks;
+            }
+        }
+      ASSERT (d->blocks_per_arena > 0);
+      d->spare_max = 0;
+      d->magazine_max = MEDIUM_MAGAZINE_SIZE;
+    }
+}
+
+/* Prints malloc() statistics for each size class that was
+   used. */
+void
+malloc_print_stats (void) 
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->hit_cnt != 0 || d->miss_cnt != 0)
+      printf ("Malloc: %zu-byte blocks: %lld hits, %lld misses, "
+              "%lld arenas allocated, %lld freed\n",
+              d->block_size, d->hit_cnt, d->miss_cnt,
+              d->arena_alloc_cnt, d->arena_free_cnt);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  void *p = allocate (size);
+#ifdef HEAP_PROFILE
+  heap_profile_alloc (p, size, __builtin_return_address (0), HEAP_MALLOC);
+#endif
+  return p;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) 
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  /* Allocate and zero memory. */
+  p = allocate (size);
+  if (p != NULL)
+    memset (p, 0, size);
+#ifdef HEAP_PROFILE
+  heap_profile_alloc (p, size, __builtin_return_address (0), HEAP_MALLOC);
+#endif
+
+  return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) 
+{
+  void *new_block = resize (old_block, new_size);
+#ifdef HEAP_PROFILE
+  if (new_size == 0 || new_block != NULL)
+    heap_profile_free (old_block);
+  heap_profile_alloc (new_block, new_size, __builtin_return_address (0),
+                      HEAP_MALLOC);
+#endif
+  return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) 
+{
+#ifdef HEAP_PROFILE
+  heap_profile_free (p);
+#endif
+  release (p);
+}
+
+/* Does the work of malloc(). */
+static void *
+allocate (size_t size) 
 {
   struct desc *d;
   struct block *b;
   struct arena *a;
+  enum intr_level old_level;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -119,28 +317,45 @@ malloc (size_t size)
       return a + 1;
     }
 
+  /* Try the magazine. */
+  old_level = intr_disable ();
+  if (d->magazine_cnt > 0)
+    {
+      b = d->magazine[--d->magazine_cnt];
+      d->hit_cnt++;
+      intr_set_level (old_level);
+      return b;
+    }
+  intr_set_level (old_level);
+
   lock_acquire (&d->lock);
+  d->miss_cnt++;
 
   /* If the free list is empty, create a new arena. */
   if (list_empty (&d->free_list))
     {
       size_t i;
 
-      /* Allocate a page. */
-      a = palloc_get_page (0);
+      /* Allocate the arena's pages. */
+      a = palloc_get_multiple (0, d->arena_pages);
       if (a == NULL) 
         {
           lock_release (&d->lock);
           return NULL; 
         }
 
-      /* Initialize arena and add its blocks to the free list. */
+      /* Initialize arena and add its blocks to the free list.
+         It counts as a spare until a block is taken from it. */
       a->magic = ARENA_MAGIC;
       a->desc = d;
       a->free_cnt = d->blocks_per_arena;
+      d->arena_alloc_cnt++;
+      d->spare_cnt++;
       for (i = 0; i < d->blocks_per_arena; i++) 
         {
           struct block *b = arena_to_block (a, i);
+          if (d->medium)
+            ((struct arena **) b)[-1] = a;
           list_push_back (&d->free_list, &b->free_elem);
         }
     }
@@ -148,32 +363,12 @@ malloc (size_t size)
   /* Get a block from free list and return it. */
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
-  a->free_cnt--;
+  if (a->free_cnt-- == d->blocks_per_arena)
+    d->spare_cnt--;
   lock_release (&d->lock);
   return b;
 }
 
-/* Allocates and return A times B bytes initialized to zeroes.
-   Returns a null pointer if memory is not available. */
-void *
-calloc (size_t a, size_t b) 
-{
-  void *p;
-  size_t size;
-
-  /* Calculate block size and make sure it fits in size_t. */
-  size = a * b;
-  if (size < a || size < b)
-    return NULL;
-
-  /* Allocate and zero memory. */
-  p = malloc (size);
-  if (p != NULL)
-    memset (p, 0, size);
-
-  return p;
-}
-
 /* Returns the number of bytes allocated for BLOCK. */
 static size_t
 block_size (void *block) 
@@ -185,38 +380,43 @@ block_size (void *block)
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
-/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
-   moving it in the process.
-   If successful, returns the new block; on failure, returns a
-   null pointer.
-   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
-   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
-void *
-realloc (void *old_block, size_t new_size) 
+/* Does the work of realloc(). */
+static void *
+resize (void *old_block, size_t new_size) 
 {
   if (new_size == 0) 
     {
-      free (old_block);
+      release (old_block);
       return NULL;
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block;
+
+      /* Resize in place if we can. */
+      if (old_block != NULL) 
+        {
+          struct arena *a = block_to_arena (old_block);
+          if (a->desc != NULL ? new_size <= a->desc->block_size
+              : resize_big_block (a, new_size))
+            return old_block;
+        }
+
+      new_block = allocate (new_size);
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
           size_t min_size = new_size < old_size ? new_size : old_size;
           memcpy (new_block, old_block, min_size);
-          free (old_block);
+          release (old_block);
         }
       return new_block;
     }
 }
 
-/* Frees block P, which must have been previously allocated with
-   malloc(), calloc(), or realloc(). */
-void
-free (void *p) 
+/* Does the work of free(). */
+static void
+release (void *p) 
 {
   if (p != NULL)
     {
@@ -228,28 +428,44 @@ free (void *p)
         {
           /* It's a normal block.  We handle it here. */
 
+          enum intr_level old_level;
+
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
+
+          /* Put the block in the magazine if there's room. */
+          old_level = intr_disable ();
+          if (d->magazine_cnt < d->magazine_max)
+            {
+              d->magazine[d->magazine_cnt++] = b;
+              intr_set_level (old_level);
+              return;
+            }
+          intr_set_level (old_level);
   
           lock_acquire (&d->lock);
 
           /* Add block to free list. */
           list_push_front (&d->free_list, &b->free_elem);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* If the arena is now entirely unused, keep it as a
+             spare, or free it if we have enough spares. */
+          if (++a->free_cnt >= d->blocks_per_arena
+              && d->spare_cnt++ >= d->spare_max)
             {
               size_t i;
 
               ASSERT (a->free_cnt == d->blocks_per_arena);
+              d->spare_cnt--;
+              d->arena_free_cnt++;
               for (i = 0; i < d->blocks_per_arena; i++) 
                 {
                   struct block *b = arena_to_block (a, i);
                   list_remove (&b->free_elem);
                 }
-              palloc_free_page (a);
+              palloc_free_multiple (a, d->arena_pages);
             }
 
           lock_release (&d->lock);
@@ -267,7 +483,14 @@ free (void *p)
 static struct arena *
 block_to_arena (struct block *b)
 {
-  struct arena *a = pg_round_down (b);
+  struct arena *a;
+
+  /* A medium block points to its arena; any other block is in
+     its arena's first page. */
+  if (pg_ofs (b) % MEDIUM_ALIGN == 0)
+    a = ((struct arena **) b)[-1];
+  else
+    a = pg_round_down (b);
 
   /* Check that the arena is valid. */
   ASSERT (a != NULL);
@@ -275,7 +498,8 @@ block_to_arena (struct block *b)
 
   /* Check that the block is properly aligned for the arena. */
   ASSERT (a->desc == NULL
-          || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
+          || ((size_t) ((uint8_t *) b - (uint8_t *) a) - a->desc->block_ofs)
+             % a->desc->block_stride == 0);
   ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
 
   return a;
@@ -289,6 +513,35 @@ arena_to_block (struct arena *a, size_t idx)
   ASSERT (a->magic == ARENA_MAGIC);
   ASSERT (idx < a->desc->blocks_per_arena);
   return (struct block *) ((uint8_t *) a
-                           + sizeof *a
-                           + idx * a->desc->block_size);
+                           + a->desc->block_ofs
+                           + idx * a->desc->block_stride);
+}
+
+/* Tries to resize the big block in arena A to hold NEW_SIZE
+   bytes without moving it, by freeing pages from its end or by
+   taking the free pages that follow it.  Returns true if
+   successful, false otherwise. */
+static bool
+resize_big_block (struct arena *a, size_t new_size) 
+{
+  size_t page_cnt;
+
+  ASSERT (a->desc == NULL);
+
+  if (new_size > SIZE_MAX - PGSIZE)
+    return false;
+  page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+
+  if (page_cnt < a->free_cnt)
+    palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                          a->free_cnt - page_cnt);
+  else if (page_cnt > a->free_cnt
+           && !palloc_extend (a, a->free_cnt, page_cnt))
+    return false;
+
+#ifdef HEAP_PROFILE
+  heap_profile_resize (a, PGSIZE * page_cnt);
+#endif
+  a->free_cnt = page_cnt;
+  return true;
 }
@@ -2,13 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/heap-profile.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,22 +25,81 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   A pool's free pages are only examined and changed with
+   interrupts off, never under a lock, so that pages can be freed
+   in the middle of a context switch, as thread_schedule_tail()
+   does for a dying thread, and taken by the idle thread.
+
+   Each pool is managed by a buddy system: free memory is kept
+   as blocks of 2**ORDER pages, aligned to their size relative to
+   the pool base, with one free list per order.  An allocation
+   splits the smallest large-enough block, and a free merges a
+   block with its buddy for as long as the buddy is free too, so
+   both take O(log n) time.  Requests that are not a power of two
+   in size are trimmed: the unused tail of the block is freed
+   again right away.
+
+   Each pool also keeps a short list of pages that the idle
+   thread has zeroed ahead of time (see palloc_prezero()), so that
+   single-page PAL_ZERO requests usually don't pay for a memset on
+   the caller's critical path.  These pages are still handed out
+   to ordinary requests when the pool otherwise runs dry.
+
+   Building with PALLOC=bitmap (which defines PALLOC_BITMAP)
+   selects the original allocator instead, which keeps a bitmap of
+   used pages and finds free runs with a linear scan. */
+
+#ifndef PALLOC_BITMAP
+/* Number of block orders.  The largest block is 2**(ORDER_CNT - 1)
+   pages, or 2 GB, more than the kernel can map. */
+#define ORDER_CNT 20
+
+/* Order map entry for the first page of a free block: the
+   block's order, or'd with BLOCK_FREE.  All other pages have
+   entry 0. */
+#define BLOCK_FREE 0x80
+#endif
+
+/* Maximum number of pre-zeroed pages kept in each pool. */
+#define ZERO_PAGE_MAX 16
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    void *zero_pages;                   /* Pre-zeroed pages, chained. */
+    size_t zero_cnt;                    /* Number of pre-zeroed pages. */
+#ifdef PALLOC_BITMAP
     struct bitmap *used_map;            /* Bitmap of free pages. */
+#else
+    size_t page_cnt;                    /* Number of pages. */
+    uint8_t *order_map;                 /* Free block heads, per page. */
+    struct list free_lists[ORDER_CNT];  /* Free blocks, by order. */
+#endif
     uint8_t *base;                      /* Base of pool. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* PAL_ZERO page requests served from and not from the pre-zeroed
+   pages. */
+static long long zero_hit_cnt, zero_miss_cnt;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void *get_multiple (enum palloc_flags, size_t page_cnt);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static bool claim_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void *take_zero_page (struct pool *);
+static bool release_zero_pages (struct pool *);
+#ifndef PALLOC_BITMAP
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static bool buddy_claim (struct pool *, size_t page_idx, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+#endif
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -69,20 +130,50 @@ palloc_init (size_t user_page_limit)
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  void *pages = get_multiple (flags, page_cnt);
+#ifdef HEAP_PROFILE
+  heap_profile_alloc (pages, PGSIZE * page_cnt, __builtin_return_address (0),
+                      HEAP_PALLOC);
+#endif
+  return pages;
+}
+
+/* Does the work of palloc_get_multiple(). */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      old_level = intr_disable ();
+      pages = take_zero_page (pool);
+      if (pages != NULL)
+        zero_hit_cnt++;
+      else
+        zero_miss_cnt++;
+      intr_set_level (old_level);
+      if (pages != NULL)
+        return pages;
+    }
+
+  old_level = intr_disable ();
+  page_idx = alloc_pages (pool, page_cnt);
+  intr_set_level (old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
+  else if (page_cnt == 1)
+    pages = take_zero_page (pool);
+  else if (release_zero_pages (pool))
+    return get_multiple (flags, page_cnt);
   else
     pages = NULL;
 
@@ -110,7 +201,12 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 void *
 palloc_get_page (enum palloc_flags flags) 
 {
-  return palloc_get_multiple (flags, 1);
+  void *page = get_multiple (flags, 1);
+#ifdef HEAP_PROFILE
+  heap_profile_alloc (page, PGSIZE, __builtin_return_address (0),
+                      HEAP_PALLOC);
+#endif
+  return page;
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
@@ -118,6 +214,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -133,12 +230,53 @@ palloc_free_multiple (void *pages, size_t page_cnt)
 
   page_idx = pg_no (pages) - pg_no (pool->base);
 
+#ifdef HEAP_PROFILE
+  heap_profile_free (pages);
+#endif
+
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
+#ifdef PALLOC_BITMAP
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+#else
+  buddy_free (pool, page_idx, page_cnt);
+#endif
+  intr_set_level (old_level);
+}
+
+/* Tries to grow the run of PAGE_CNT pages at PAGES, obtained
+   from palloc_get_multiple(), to NEW_CNT pages by taking the
+   pages that follow it.  Returns true if successful, false if
+   any of those pages is in use or outside the pool.  The new
+   pages are not zeroed. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_cnt) 
+{
+  struct pool *pool;
+  enum intr_level old_level;
+  size_t page_idx;
+  bool success;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (page_cnt > 0 && new_cnt >= page_cnt);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base);
+  old_level = intr_disable ();
+  success = claim_pages (pool, page_idx + page_cnt, new_cnt - page_cnt);
+  intr_set_level (old_level);
+
+  return success;
 }
 
 /* Frees the page at PAGE. */
@@ -148,11 +286,135 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Called by the idle thread to zero a page ahead of demand.
+   Takes a free page from a pool whose supply of pre-zeroed pages
+   is short, zeroes it and adds it to that supply.  Returns true
+   if it did so, false if there was nothing to do.
+
+   Never blocks and never holds a lock: a preempted idle thread
+   does not run again until nothing else is ready, so no other
+   thread may ever have to wait for it. */
+bool
+palloc_prezero (void)
+{
+  struct pool *pools[] = {&kernel_pool, &user_pool};
+  size_t i;
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *pool = pools[i];
+      enum intr_level old_level;
+      size_t page_idx;
+      void *page;
+
+      /* The timer interrupt may switch away from the idle
+         thread at any point outside this section, so the pool
+         is never left half changed. */
+      old_level = intr_disable ();
+      page_idx = (pool->zero_cnt < ZERO_PAGE_MAX
+                  ? alloc_pages (pool, 1) : BITMAP_ERROR);
+      intr_set_level (old_level);
+      if (page_idx == BITMAP_ERROR)
+        continue;
+
+      page = pool->base + PGSIZE * page_idx;
+      memset (page, 0, PGSIZE);
+
+      old_level = intr_disable ();
+      *(void **) page = pool->zero_pages;
+      pool->zero_pages = page;
+      pool->zero_cnt++;
+      intr_set_level (old_level);
+      return true;
+    }
+  return false;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  printf ("Palloc: %lld pre-zeroed page hits, %lld misses\n",
+          zero_hit_cnt, zero_miss_cnt);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if there aren't enough free
+   pages.  Interrupts must be off. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+#ifdef PALLOC_BITMAP
+  return bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+#else
+  return buddy_alloc (pool, page_cnt);
+#endif
+}
+
+/* Allocates the PAGE_CNT pages starting at PAGE_IDX in POOL if
+   they are all free.  Returns true if successful, false
+   otherwise.  Interrupts must be off. */
+static bool
+claim_pages (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+#ifdef PALLOC_BITMAP
+  if (page_idx + page_cnt > bitmap_size (pool->used_map)
+      || !bitmap_none (pool->used_map, page_idx, page_cnt))
+    return false;
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+  return true;
+#else
+  return buddy_claim (pool, page_idx, page_cnt);
+#endif
+}
+
+/* Removes and returns one of POOL's pre-zeroed pages, or a null
+   pointer if it has none. */
+static void *
+take_zero_page (struct pool *pool)
+{
+  enum intr_level old_level = intr_disable ();
+  void **page = pool->zero_pages;
+
+  if (page != NULL)
+    {
+      pool->zero_pages = *page;
+      pool->zero_cnt--;
+    }
+  intr_set_level (old_level);
+
+  if (page != NULL)
+    *page = NULL;
+  return page;
+}
+
+/* Returns all of POOL's pre-zeroed pages to its free pages, so
+   that they can be part of a multiple-page allocation.  Returns
+   true if there were any. */
+static bool
+release_zero_pages (struct pool *pool)
+{
+  bool released = false;
+  void *page;
+
+  while ((page = take_zero_page (pool)) != NULL)
+    {
+      palloc_free_page (page);
+      released = true;
+    }
+  return released;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
+#ifdef PALLOC_BITMAP
   /* We'll put the pool's used_map at its base.
      Calculate the space needed for the bitmap
      and subtract it from the pool's size. */
@@ -164,9 +426,33 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
+  p->zero_pages = NULL;
+  p->zero_cnt = 0;
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
+#else
+  /* We'll put the pool's order_map at its base, one byte per
+     page that remains. */
+  size_t map_pages = DIV_ROUND_UP (page_cnt, PGSIZE + 1);
+  int order;
+
+  if (map_pages > page_cnt)
+    PANIC ("Not enough memory in %s for order map.", name);
+  page_cnt -= map_pages;
+
+  printf ("%zu pages available in %s.\n", page_cnt, name);
+
+  /* Initialize the pool, then free all of its pages. */
+  p->zero_pages = NULL;
+  p->zero_cnt = 0;
+  p->page_cnt = page_cnt;
+  p->order_map = base;
+  memset (p->order_map, 0, page_cnt);
+  for (order = 0; order < ORDER_CNT; order++)
+    list_init (&p->free_lists[order]);
+  p->base = (uint8_t *) base + map_pages * PGSIZE;
+  buddy_free (p, 0, page_cnt);
+#endif
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +462,184 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
+#ifdef PALLOC_BITMAP
   size_t end_page = start_page + bitmap_size (pool->used_map);
+#else
+  size_t end_page = start_page + pool->page_cnt;
+#endif
 
   return page_no >= start_page && page_no < end_page;
 }
+#ifndef PALLOC_BITMAP
+
+/* Returns the free list element stored in page PAGE_IDX of
+   POOL. */
+static struct list_elem *
+block_elem (const struct pool *pool, size_t page_idx)
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index of the page whose free list element is E in
+   POOL. */
+static size_t
+block_idx (const struct pool *pool, struct list_elem *e)
+{
+  return ((uint8_t *) e - pool->base) / PGSIZE;
+}
+
+/* Returns the largest order such that 2**order <= N.  N must be
+   nonzero. */
+static int
+floor_order (size_t n)
+{
+  return 31 - __builtin_clz (n);
+}
+
+/* Adds the free block of 2**ORDER pages at PAGE_IDX to POOL,
+   merging it with its buddy, and the result with its own buddy,
+   and so on, for as long as the buddy is entirely free. */
+static void
+buddy_free_block (struct pool *pool, size_t page_idx, int order)
+{
+  for (; order < ORDER_CNT - 1; order++)
+    {
+      size_t buddy_idx = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy_idx + ((size_t) 1 << order) > pool->page_cnt
+          || pool->order_map[buddy_idx] != (BLOCK_FREE | order))
+        break;
+      list_remove (block_elem (pool, buddy_idx));
+      pool->order_map[buddy_idx] = 0;
+      if (buddy_idx < page_idx)
+        page_idx = buddy_idx;
+    }
+  pool->order_map[page_idx] = BLOCK_FREE | order;
+  list_push_front (&pool->free_lists[order], block_elem (pool, page_idx));
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, by
+   splitting them into the largest blocks that are aligned to
+   their own size. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  ASSERT (page_idx + page_cnt <= pool->page_cnt);
+
+  while (page_cnt > 0)
+    {
+      int order = floor_order (page_cnt);
+      if (order > ORDER_CNT - 1)
+        order = ORDER_CNT - 1;
+      if (page_idx != 0 && __builtin_ctz (page_idx) < order)
+        order = __builtin_ctz (page_idx);
+
+      ASSERT (!(pool->order_map[page_idx] & BLOCK_FREE));
+      buddy_free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if no free block is
+   large enough. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt)
+{
+  int want = floor_order (page_cnt);
+  size_t page_idx;
+  int order;
+
+  if (((size_t) 1 << want) < page_cnt)
+    want++;
+
+  /* Take the smallest free block that is big enough. */
+  for (order = want; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  if (order >= ORDER_CNT)
+    return BITMAP_ERROR;
+  page_idx = block_idx (pool, list_pop_front (&pool->free_lists[order]));
+  pool->order_map[page_idx] = 0;
+
+  /* Split it down to the size we want, freeing the upper
+     halves. */
+  while (order > want)
+    {
+      size_t half_idx;
+
+      order--;
+      half_idx = page_idx + ((size_t) 1 << order);
+      pool->order_map[half_idx] = BLOCK_FREE | order;
+      list_push_front (&pool->free_lists[order],
+                       block_elem (pool, half_idx));
+    }
+
+  /* Give back the pages beyond PAGE_CNT. */
+  if (((size_t) 1 << want) > page_cnt)
+    buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+
+  return page_idx;
+}
+
+/* Looks for the free block in POOL that contains page PAGE_IDX.
+   If there is one, stores its first page in *BLOCK_IDX and its
+   order in *ORDER and returns true; otherwise, returns false. */
+static bool
+find_free_block (const struct pool *pool, size_t page_idx,
+                 size_t *block_idx, int *order)
+{
+  int o;
+
+  for (o = 0; o < ORDER_CNT; o++)
+    {
+      size_t head = page_idx & ~(((size_t) 1 << o) - 1);
+      if (pool->order_map[head] == (BLOCK_FREE | o))
+        {
+          *block_idx = head;
+          *order = o;
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Allocates the PAGE_CNT pages starting at PAGE_IDX in POOL if
+   they are all free, splitting the free blocks that cover them
+   and freeing the parts outside the range again.  Returns true
+   if successful, false otherwise. */
+static bool
+buddy_claim (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t end = page_idx + page_cnt;
+  size_t block_idx;
+  int order;
+  size_t i;
+
+  if (end > pool->page_cnt)
+    return false;
+
+  /* Check that free blocks cover the whole range. */
+  for (i = page_idx; i < end; i = block_idx + ((size_t) 1 << order))
+    if (!find_free_block (pool, i, &block_idx, &order))
+      return false;
+
+  /* Take the blocks, giving back whatever sticks out. */
+  for (i = page_idx; i < end; )
+    {
+      size_t block_end;
+
+      find_free_block (pool, i, &block_idx, &order);
+      block_end = block_idx + ((size_t) 1 << order);
+      list_remove (block_elem (pool, block_idx));
+      pool->order_map[block_idx] = 0;
+      if (block_idx < page_idx)
+        buddy_free (pool, block_idx, page_idx - block_idx);
+      if (block_end > end)
+        buddy_free (pool, end, block_end - end);
+      i = block_end;
+    }
+  return true;
+}
+#endif /* !PALLOC_BITMAP */
@@ -32,6 +32,7 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+static heap_less_func waiter_less;
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -48,7 +49,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, waiter_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -69,7 +70,16 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0)
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+
+      heap_push (&sema->waiters, &cur->waitelem);
+      /* In cond_wait(), the condition's queue is the one whose
+         order matters, so it takes precedence. */
+      if (cur->wait_queue == NULL)
+        {
+          cur->wait_queue = &sema->waiters;
+          cur->wait_queue_elem = &cur->waitelem;
+        }
       thread_block ();
     }
   sema->value--;
@@ -115,17 +125,27 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   sema->value++;
-  if (!list_empty (&sema->waiters)) {
-    // here
-    struct list_elem* e = list_max (&sema->waiters, priority_comparator, NULL);
-    struct thread *higher_pt = list_entry(e, struct thread, elem);
-    list_remove(e); // Remove the highest priority thread from the waiters list
+  if (!heap_empty (&sema->waiters)) {
+    // Remove the highest priority thread from the waiters queue
+    struct thread *higher_pt = heap_entry (heap_pop (&sema->waiters),
+                                           struct thread, waitelem);
+    if (higher_pt->wait_queue == &sema->waiters)
+      higher_pt->wait_queue = NULL;
     thread_unblock (higher_pt);
   }
 
   intr_set_level (old_level);
 }
 
+/* Orders semaphore waiters A and B by priority. */
+static bool
+waiter_less (const struct heap_elem *a, const struct heap_elem *b,
+             void *aux UNUSED)
+{
+  return (heap_entry (a, struct thread, waitelem)->priority
+          < heap_entry (b, struct thread, waitelem)->priority);
+}
+
 static void sema_test_helper (void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -185,84 +205,90 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
-  lock->priority_donation = false;
+  lock->max_waiter_priority = PRI_MIN - 1;
 }
 
-/* We maintain a list of acquired lokcs for every thread.
-If this list is empty then the thread's attributs related to priority donation are reset as
-there is no need of priority donation for this case.
-Else, we go through the list of acquired locks and set the concerned thread's priority as the
-maximum of the lock priorities. Here, it has to be noted that we maintian the priority value in each lock based on the
-lock holder thread's priority.
+/* We maintain a list of acquired locks for every thread, and every lock caches the highest
+priority among the threads waiting for it.  A thread's effective priority is the maximum of
+its own priority and the cached priorities of the locks it holds, so recomputing it costs
+O(held locks) and never looks at the waiters themselves.
+Interrupts must be off.
 */
-static void
+void
 set_priority_based_on_acquired_locks(struct thread* thread)
 {
-  if(list_empty(&thread->acquired_locks))
-  {
-    if(!thread->priority_donation)
-      return; // Ideal case without any priority donation
+  ASSERT (intr_get_level () == INTR_OFF);
 
-    thread->priority_donation = false;
-    thread->priority = thread->priority_before_donation;
-  }
-  else
-  {
-    int max_priority = PRI_MIN;
-    bool priority_donation = false;
-    struct list_elem *curr;
+  int max_priority = thread->priority_before_donation;
+  struct list_elem *curr;
 
-    for (curr = list_begin (&thread->acquired_locks); curr != list_end (&thread->acquired_locks);
-         curr = list_next (curr))
-    {
-      struct lock *l = list_entry (curr, struct lock, elem);
-      if(!l->priority_donation)
-        continue;
-      priority_donation = true;
-      if(max_priority < l->donated_priority)
-        max_priority = l->donated_priority;
-    }
-    //if atleast one of the acquired locks has a donated priority then we use that
-    //else we return by resetting the priority donation related attributes of the thread
-    if(priority_donation)
-    {
-      thread->priority = max_priority;
-    }
-    else
-    {
-      thread->priority_donation = false;
-      thread->priority = thread->priority_before_donation;
-    }
+  for (curr = list_begin (&thread->acquired_locks); curr != list_end (&thread->acquired_locks);
+       curr = list_next (curr))
+  {
+    struct lock *l = list_entry (curr, struct lock, elem);
+    if(max_priority < l->max_waiter_priority)
+      max_priority = l->max_waiter_priority;
   }
+
+  thread->priority_donation = max_priority > thread->priority_before_donation;
+  thread_change_priority (thread, max_priority);
 }
 
-/* Helper method to handle nested and chained priority donation
-The steps are as follows:
-a) If the lock holder has a higher priority than the current thread's priority then return
-b) Else, we donate the priority to the thread using the locks acquired by it
-c) We do this by taking the max of the donated priorities to the concerned thread
-d) If the locks owner is waiting for a different lock then repeat the process
+/* Helper method to handle nested and chained priority donation of PRIORITY by a thread
+waiting for LOCK.  The steps are as follows:
+a) Raise LOCK's cached waiter priority.  If it was already at least PRIORITY, then so is
+   its holder's priority and everything further along the chain, so stop.
+b) Else, raise the lock holder's priority to PRIORITY.
+c) If the holder is waiting for a different lock then repeat the process
 till we reach the thread which is not waiting on any lock.
+Each step is O(1), so donation costs O(depth of the chain).
 */
 static void
-donate_priority(struct thread* owner, struct lock* lock, int priority)
+donate_priority(struct lock* lock, int priority)
+{
+  while (lock != NULL && lock->max_waiter_priority < priority)
+  {
+    struct thread *owner = lock->holder;
+
+    lock->max_waiter_priority = priority;
+    if (owner == NULL || owner->priority >= priority)
+      break;
+
+    owner->priority_donation = true;
+    thread_change_priority (owner, priority);
+    lock = owner->waiting_lock;
+  }
+}
+
+/* Returns the highest priority among the threads waiting for
+   LOCK, or PRI_MIN - 1 if there are none. */
+static int
+lock_max_waiter_priority (struct lock *lock)
 {
-  if(owner->priority >= priority)
-    return;
+  struct heap *waiters = &lock->semaphore.waiters;
+
+  if (heap_empty (waiters))
+    return PRI_MIN - 1;
+  return heap_entry (heap_top (waiters), struct thread, waitelem)->priority;
+}
 
-  owner->priority_donation = true;
-  lock->priority_donation = true;
-  lock->donated_priority = priority;
+/* Records LOCK as acquired by the current thread.  The threads
+   still waiting for LOCK now donate to the current thread.
+   Interrupts must be off. */
+static void
+lock_take (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
 
-  // Set the owner's priority to the max of the acquired locks with priority donation
-  set_priority_based_on_acquired_locks(owner);
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  // Check if the owner is waiting for a lock
-  struct lock* next_lock = owner->waiting_lock;
-  if(next_lock)
+  lock->holder = cur;
+  lock->max_waiter_priority = lock_max_waiter_priority (lock);
+  list_push_back (&cur->acquired_locks, &lock->elem);
+  if (lock->max_waiter_priority > cur->priority)
   {
-    struct thread* next_owner = next_lock->holder;
-    donate_priority(next_owner, next_lock, priority);
+    cur->priority_donation = true;
+    thread_change_priority (cur, lock->max_waiter_priority);
   }
 }
 
@@ -285,28 +311,20 @@ lock_acquire (struct lock *lock)
   // Since we cannot use a lock here, we have to disable the interrupts.
   enum intr_level old_level = intr_disable ();
 
-  //check if anyone is holding the lock
-  struct thread *owner = lock->holder;
-  //if there is a holding thread then we try to donate the priority
-  //also, till the lock is released by the holding thread we add this lock to the
+  //if there is a holding thread then we donate our priority along the chain of lock
+  //holders, and till the lock is released by the holding thread we add this lock to the
   //current threads's waiting lock attribute.
-  //then, we execute recursive priority donation on the lock holder thread
-  if(owner)
+  if(lock->holder)
   {
-    int current_priority = thread_current()->priority;
-    // Add to your waiting lock
     thread_current()->waiting_lock = lock;
-    donate_priority(owner, lock, current_priority);
+    donate_priority(lock, thread_current()->priority);
   }
 
   sema_down (&lock->semaphore);
 
-  lock->holder = thread_current();
-
   // Remove from the waiting lock
   thread_current()->waiting_lock = NULL;
-  // Add the lock to the list of acquired locks
-  list_push_back(&thread_current()->acquired_locks, &lock->elem);
+  lock_take (lock);
 
   intr_set_level (old_level);
 }
@@ -320,14 +338,17 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    lock_take (lock);
+  intr_set_level (old_level);
   return success;
 }
 
@@ -339,19 +360,20 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock)
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   lock->holder = NULL;
-  //We toggle the flag related to priority donation to false
-  lock->priority_donation = false;
   //we remove this lock from the acquired list
   list_remove(&lock->elem);
-  struct thread* curr_thread = thread_current();
   //reset the priority of the current thread as the concerned lock has been released
   //The new priority depends on the other locks being held by the current thread
-  set_priority_based_on_acquired_locks(curr_thread);
+  set_priority_based_on_acquired_locks(thread_current ());
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -365,14 +387,26 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
+/* One semaphore in a condition's wait queue. */
 struct semaphore_elem
   {
-    struct list_elem elem;              /* List element. */
+    struct heap_elem elem;              /* Heap element. */
     struct semaphore semaphore;         /* This semaphore. */
     struct thread* t; /* thread using this struct */
   };
 
+/* Orders condition waiters A and B by the priority of their
+   threads. */
+static bool
+compare_semaphore_elem_priority (const struct heap_elem *a,
+                                 const struct heap_elem *b,
+                                 void *aux UNUSED)
+{
+  struct thread *first_thread = heap_entry (a, struct semaphore_elem, elem)->t;
+  struct thread *second_thread = heap_entry (b, struct semaphore_elem, elem)->t;
+  return first_thread->priority < second_thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -381,7 +415,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, compare_semaphore_elem_priority, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -408,6 +442,7 @@ void
 cond_wait (struct condition *cond, struct lock *lock)
 {
   struct semaphore_elem waiter;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
@@ -417,25 +452,18 @@ cond_wait (struct condition *cond, struct lock *lock)
   waiter.t = thread_current();
 
   sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
+  /* Priority donation may reorder COND's queue from another
+     thread, so it is only touched with interrupts off. */
+  old_level = intr_disable ();
+  heap_push (&cond->waiters, &waiter.elem);
+  waiter.t->wait_queue = &cond->waiters;
+  waiter.t->wait_queue_elem = &waiter.elem;
+  intr_set_level (old_level);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
-static bool compare_semaphore_elem_priority (const struct list_elem *a,
-                             const struct list_elem *b,
-                             void *aux UNUSED)
-{
-  struct thread *first_thread = list_entry (a, struct semaphore_elem, elem)->t;
-  struct thread *second_thread = list_entry (b, struct semaphore_elem, elem)->t;
-  if (first_thread->priority < second_thread->priority) {
-    return true;
-  } else {
-    return false;
-  }
-}
-
 /* If any threads are waiting on COND (protected by LOCK), then
    this function signals one of them to wake up from its wait.
    LOCK must be held before calling this function.
@@ -451,12 +479,15 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters))
+  if (!heap_empty (&cond->waiters))
   {
-    struct list_elem* e = list_max (&cond->waiters, compare_semaphore_elem_priority, NULL);
-    struct semaphore_elem *higher_pt = list_entry(e, struct semaphore_elem, elem);
-    list_remove(e); // Remove the highest priority thread from the waiters list
+    enum intr_level old_level = intr_disable ();
+    // Remove the highest priority thread from the waiters queue
+    struct semaphore_elem *higher_pt = heap_entry (heap_pop (&cond->waiters),
+                                                   struct semaphore_elem, elem);
+    higher_pt->t->wait_queue = NULL;
     sema_up (&higher_pt->semaphore);
+    intr_set_level (old_level);
   }
 }
 
@@ -472,6 +503,6 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!heap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
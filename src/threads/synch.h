@@ -1,6 +1,7 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
 
@@ -8,7 +9,7 @@
 struct semaphore
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, by priority. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -23,10 +24,8 @@ struct lock
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
 
-    bool priority_donation; /* Set as true if the lock is involved in priority donation*/
-    int donated_priority; // This is meaningful only if priority_donation = true
-
-    struct list_elem elem;
+    int max_waiter_priority;    /* Highest priority of any waiter. */
+    struct list_elem elem;      /* Element in holder's acquired_locks. */
   };
 
 void lock_init (struct lock *);
@@ -34,15 +33,12 @@ void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
-// here
-bool priority_comparator (const struct list_elem *a,
-                             const struct list_elem *b,
-                             void *aux);
+void set_priority_based_on_acquired_locks (struct thread *);
 
 /* Condition variable. */
 struct condition
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, by priority. */
   };
 
 void cond_init (struct condition *);
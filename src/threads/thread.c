@@ -4,6 +4,7 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -11,6 +12,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -20,9 +22,15 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queue of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one FIFO list per priority level, and bit P of
+   ready_bitmap is set exactly when ready_queues[P] is nonempty,
+   so that the highest-priority ready thread can be found with a
+   single bit scan instead of walking every ready thread. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_bitmap;
+static size_t ready_cnt;        /* # of threads in ready_queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -50,9 +58,38 @@ static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
+/* Ready-wait histogram summed over every thread that has run,
+   including those that have since exited.  Same buckets as
+   struct thread's `wait_hist'. */
+static unsigned ready_wait_hist[WAIT_HIST_BUCKETS];
+
+/* Cache of free thread pages, so that thread_create() and a
+   dying thread usually skip the page allocator's lock and bitmap
+   scan.  The pages are chained through their first word and are
+   returned to the page allocator only beyond thread_cache_max.
+   Accessed only with interrupts off. */
+size_t thread_cache_max = 16;
+static void *thread_cache;
+static size_t thread_cache_cnt;
+static long long thread_cache_hits, thread_cache_misses;
+
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+static long long context_switches; /* # of switches between threads. */
+
+/* Time slice policy.  Controlled by kernel command-line option
+   "-slice=POLICY". */
+enum thread_slice_policy thread_slice_policy;
+
+/* Under SLICE_ADAPTIVE, the time slice for each band of
+   PRI_BAND_SIZE priorities, from lowest to highest.  Interactive
+   threads sit in the high bands and are preempted soon, so that
+   others get to respond; CPU-bound threads drift down to the low
+   bands and run longer between switches. */
+#define PRI_BAND_SIZE 16
+static const unsigned band_slice[(PRI_MAX + 1) / PRI_BAND_SIZE] =
+  {16, 8, 4, 2};
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
@@ -70,6 +107,14 @@ bool thread_mlfqs;
 */
 static int load_avg = 0;
 
+/* Once-per-second recent_cpu decay state.  See
+   start_recent_cpu_decay(). */
+#define DECAY_HISTORY 8         /* # of past coefficients remembered. */
+#define DECAY_BATCH 8           /* Max threads decayed per timer tick. */
+static int decay_epoch;         /* # of decays started since boot. */
+static int decay_coefficients[DECAY_HISTORY];   /* By epoch. */
+static struct list_elem *decay_cursor;  /* Next thread to decay. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -81,9 +126,16 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
-bool priority_comparator (const struct list_elem *a,
-                             const struct list_elem *b,
-                             void *aux);
+static void ready_list_insert (struct thread *);
+static void ready_list_remove (struct thread *);
+static int ready_list_max_priority (void);
+static bool compute_recent_cpu (struct thread *);
+static void compute_priority_for_mlfqs (struct thread *);
+static int64_t account_status (struct thread *);
+static int wait_hist_bucket (int64_t ticks);
+static unsigned time_slice (const struct thread *);
+static struct thread *thread_page_alloc (void);
+static void thread_page_free (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -101,11 +153,17 @@ bool priority_comparator (const struct list_elem *a,
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  ready_bitmap = 0;
+  ready_cnt = 0;
   list_init (&all_list);
+  decay_cursor = list_end (&all_list);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -149,16 +207,123 @@ thread_tick (void)
     kernel_ticks++;
 
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++thread_ticks >= time_slice (t))
     intr_yield_on_return ();
 }
 
+/* Returns the number of timer ticks T may run before it is
+   preempted. */
+static unsigned
+time_slice (const struct thread *t)
+{
+  if (thread_slice_policy == SLICE_ADAPTIVE)
+    return band_slice[t->priority / PRI_BAND_SIZE];
+  return TIME_SLICE;
+}
+
+/* Returns the name of the current time slice policy. */
+const char *
+thread_slice_policy_name (void)
+{
+  return thread_slice_policy == SLICE_ADAPTIVE ? "adaptive" : "fixed";
+}
+
+/* Returns the number of switches from one thread to another since
+   boot. */
+long long
+thread_context_switches (void)
+{
+  return context_switches;
+}
+
+/* Credits N timer ticks that passed without timer interrupts
+   while the idle thread had the CPU halted.  See
+   timer_idle_enter(). */
+void
+thread_tick_idle (int64_t n)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  idle_ticks += n;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld context switches, %s time slices\n",
+          context_switches, thread_slice_policy_name ());
+  printf ("Thread cache: %lld hits, %lld misses, %zu pages cached\n",
+          thread_cache_hits, thread_cache_misses, thread_cache_cnt);
+  if (timer_tickless)
+    printf ("Tickless idle: %lld timer interrupts saved\n",
+            timer_tickless_saved ());
+  thread_print_sched_stats ();
+}
+
+/* Prints the nonzero buckets of ready-wait histogram HIST on one
+   line, labeled by the range of ticks each bucket covers. */
+static void
+print_wait_hist (const unsigned hist[WAIT_HIST_BUCKETS])
+{
+  int b;
+
+  for (b = 0; b < WAIT_HIST_BUCKETS; b++)
+    if (hist[b] != 0)
+      {
+        if (b == 0)
+          printf (" 0:%u", hist[b]);
+        else if (b == WAIT_HIST_BUCKETS - 1)
+          printf (" %d+:%u", 1 << (b - 1), hist[b]);
+        else if (b == 1)
+          printf (" 1:%u", hist[b]);
+        else
+          printf (" %d-%d:%u", 1 << (b - 1), (1 << b) - 1, hist[b]);
+      }
+  printf ("\n");
+}
+
+/* Prints one line of scheduler statistics for T, followed by its
+   ready-wait histogram.  Time in T's current status that has not
+   been charged yet is included. */
+static void
+print_sched_stats (struct thread *t, void *aux UNUSED)
+{
+  int64_t now = timer_ticks ();
+  int64_t run = t->run_ticks;
+  int64_t ready = t->ready_ticks;
+  int64_t blocked = t->blocked_ticks;
+
+  if (t->status == THREAD_RUNNING)
+    run += now - t->state_since;
+  else if (t->status == THREAD_READY)
+    ready += now - t->state_since;
+  else if (t->status == THREAD_BLOCKED)
+    blocked += now - t->state_since;
+
+  printf ("%5d %-15s %8u %10lld %10lld %10lld\n",
+          t->tid, t->name, t->switches, run, ready, blocked);
+  printf ("      ready wait:");
+  print_wait_hist (t->wait_hist);
+}
+
+/* Prints per-thread scheduler statistics for every live thread:
+   how often each was scheduled, how many ticks it spent running,
+   ready but not running, and blocked, and how long it waited in
+   the ready queue each time it was scheduled. */
+void
+thread_print_sched_stats (void)
+{
+  enum intr_level old_level = intr_disable ();
+
+  printf ("Scheduler: ticks per thread\n");
+  printf ("  tid name            switches        run      ready    blocked\n");
+  thread_foreach (print_sched_stats, NULL);
+  printf ("  all threads ready wait:");
+  print_wait_hist (ready_wait_hist);
+  intr_set_level (old_level);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -189,7 +354,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_alloc ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -230,6 +395,7 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  account_status (thread_current ());
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -251,13 +417,12 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  account_status (t);
+  ready_list_insert (t);
   t->status = THREAD_READY;
 
   //check max priority
-  struct list_elem* e = list_max (&ready_list, priority_comparator, NULL);
-  struct thread *higher_pt = list_entry(e, struct thread, elem);
-  if (thread_current ()->priority < higher_pt->priority) {
+  if (thread_current ()->priority < ready_list_max_priority ()) {
     //if interrupt context --> int_yield on reutrn; else thread_yield
     if (intr_context ()) {
       intr_yield_on_return ();
@@ -320,6 +485,8 @@ thread_exit (void)
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  if (decay_cursor == &thread_current ()->allelem)
+    decay_cursor = list_next (decay_cursor);
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -338,8 +505,10 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread)
-    list_push_back (&ready_list, &cur->elem);
-    //ready_list_insert (cur);
+    ready_list_insert (cur);
+  else
+    timer_idle_exit ();
+  account_status (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -367,9 +536,7 @@ yield_if_necessary(void)
 {
   enum intr_level old_level = intr_disable ();
   //check max priority
-  struct list_elem* e = list_max (&ready_list, priority_comparator, NULL);
-  struct thread *higher_pt = list_entry(e, struct thread, elem);
-  if (thread_current ()->priority < higher_pt->priority) {
+  if (thread_current ()->priority < ready_list_max_priority ()) {
     if(intr_context())
       intr_yield_on_return();
     else
@@ -382,12 +549,15 @@ yield_if_necessary(void)
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority_before_donation = new_priority;
-  //if the current thread has undergone donation then do not set the priority
-  if(thread_current()->priority_donation)
-    return; // Do nothing
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
-  thread_current ()->priority = new_priority;
+  //the effective priority stays the maximum of the new priority and
+  //the priorities donated through the locks still held
+  old_level = intr_disable ();
+  cur->priority_before_donation = new_priority;
+  set_priority_based_on_acquired_locks (cur);
+  intr_set_level (old_level);
   yield_if_necessary();
 }
 
@@ -400,9 +570,18 @@ thread_get_priority (void)
 
 /* Sets the current thread's nice value to NICE. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  thread_current ()->nice = nice;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+
+  // Decays owed from before the change use the old nice value
+  if (thread_mlfqs)
+    compute_recent_cpu (cur);
+  cur->nice = nice;
+  if (thread_mlfqs)
+    compute_priority_for_mlfqs (cur);
+  intr_set_level (old_level);
   yield_if_necessary();
 }
 
@@ -417,7 +596,7 @@ thread_get_nice (void)
 int
 thread_get_load_avg (void)
 {
-  int l = (load_avg * 100 + F_BY_2) / F;
+  int l = fp_to_int_nearest (load_avg * 100);
   return l;
 }
 
@@ -425,8 +604,12 @@ thread_get_load_avg (void)
 int
 thread_get_recent_cpu (void)
 {
+  enum intr_level old_level = intr_disable ();
+  if (thread_mlfqs)
+    compute_recent_cpu (thread_current ());
   int recent_cpu = thread_current()->recent_cpu;
-  int l = (recent_cpu * 100 + F_BY_2) / F;
+  intr_set_level (old_level);
+  int l = fp_to_int_nearest (recent_cpu * 100);
   return l;
 }
 
@@ -450,8 +633,20 @@ idle (void *idle_started_ UNUSED)
     {
       /* Let someone else run. */
       intr_disable ();
+      timer_idle_exit ();
       thread_block ();
 
+      /* With nothing else to run, zero some pages ahead of
+         demand.  Any thread that becomes ready preempts us. */
+      intr_enable ();
+      while (palloc_prezero ())
+        continue;
+      intr_disable ();
+
+      /* In tickless mode, stop the periodic timer interrupt
+         until the next sleeper is due. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -516,11 +711,19 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->state_since = timer_ticks ();
   // Set recent_cpu
   if(t == initial_thread)
     t->recent_cpu = 0; // It will be zero for the initial thread.
   else
+  {
+    old_level = intr_disable ();
+    if (thread_mlfqs)
+      compute_recent_cpu (thread_current ());
     t->recent_cpu = thread_current()->recent_cpu; // inherit from the parent
+    intr_set_level (old_level);
+  }
+  t->decay_epoch = decay_epoch;
   t->priority_donation = false;
   t->priority_before_donation = priority;
   list_init(&t->acquired_locks);
@@ -545,18 +748,80 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Helper method to compare the elements of the ready list based on their priorities*/
-bool priority_comparator (const struct list_elem *a,
-                             const struct list_elem *b,
-                             void *aux UNUSED)
+/* Appends T to the tail of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_list_insert (struct thread *t)
 {
-  struct thread *first_thread = list_entry (a, struct thread, elem);
-  struct thread *second_thread = list_entry (b, struct thread, elem);
-  if (first_thread->priority < second_thread->priority) {
-    return true;
-  } else {
-    return false;
-  }
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_bitmap |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes T from the run queue for its priority.  Interrupts
+   must be off. */
+static void
+ready_list_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_bitmap &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Returns the highest priority of any thread in the run queue,
+   or PRI_MIN - 1 if the run queue is empty.  The bitmap is
+   scanned as two 32-bit halves so that the bit scan compiles to
+   a single bsr instead of a libgcc helper. */
+static int
+ready_list_max_priority (void)
+{
+  uint32_t hi = ready_bitmap >> 32;
+  uint32_t lo = ready_bitmap;
+
+  if (hi != 0)
+    return 63 - __builtin_clz (hi);
+  else if (lo != 0)
+    return 31 - __builtin_clz (lo);
+  else
+    return PRI_MIN - 1;
+}
+
+/* Sets T's effective priority to PRIORITY.  If T is in the run
+   queue, it is moved to the tail of the queue for its new
+   priority so that the run queue stays consistent.  If T is in
+   a priority-ordered wait queue, its place there is updated.
+   Does not yield; callers decide whether preemption is needed. */
+void
+thread_change_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable ();
+  if (t->priority != priority)
+    {
+      bool ready = t->status == THREAD_READY && t != idle_thread;
+
+      if (ready)
+        ready_list_remove (t);
+      t->priority = priority;
+      if (ready)
+        ready_list_insert (t);
+
+      /* cond_wait() queues T before it releases its lock and
+         blocks, so T may be in a wait queue in any state. */
+      if (t->wait_queue != NULL)
+        heap_update (t->wait_queue, t->wait_queue_elem);
+    }
+  intr_set_level (old_level);
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
@@ -567,17 +832,50 @@ bool priority_comparator (const struct list_elem *a,
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  if (ready_cnt == 0)
     return idle_thread;
   else
   {
-    struct list_elem* e = list_max (&ready_list, priority_comparator, NULL);
-    struct thread *higher_pt = list_entry(e, struct thread, elem);
-    list_remove(e); // Remove the highest priority thread from the ready list
+    struct list *q = &ready_queues[ready_list_max_priority ()];
+    struct thread *higher_pt = list_entry(list_front (q), struct thread, elem);
+    ready_list_remove (higher_pt); // Remove the highest priority thread from the run queue
     return higher_pt;
   }
 }
 
+/* Charges the ticks since T last changed status to the counter
+   for its current status and restarts the clock.  Must be called
+   with interrupts off, just before T->status changes.  Returns
+   the number of ticks charged. */
+static int64_t
+account_status (struct thread *t)
+{
+  int64_t now = timer_ticks ();
+  int64_t elapsed = now - t->state_since;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->status == THREAD_RUNNING)
+    t->run_ticks += elapsed;
+  else if (t->status == THREAD_READY)
+    t->ready_ticks += elapsed;
+  else if (t->status == THREAD_BLOCKED)
+    t->blocked_ticks += elapsed;
+  t->state_since = now;
+  return elapsed;
+}
+
+/* Returns the ready-wait histogram bucket for a wait of TICKS. */
+static int
+wait_hist_bucket (int64_t ticks)
+{
+  if (ticks <= 0)
+    return 0;
+  if (ticks >= 1 << (WAIT_HIST_BUCKETS - 2))
+    return WAIT_HIST_BUCKETS - 1;
+  return 32 - __builtin_clz ((unsigned) ticks);
+}
+
 /* Completes a thread switch by activating the new thread's page
    tables, and, if the previous thread is dying, destroying it.
 
@@ -601,6 +899,19 @@ thread_schedule_tail (struct thread *prev)
 
   ASSERT (intr_get_level () == INTR_OFF);
 
+  /* Charge the time we spent waiting in the ready queue. */
+  if (cur->status == THREAD_READY)
+    {
+      int bucket = wait_hist_bucket (account_status (cur));
+      cur->wait_hist[bucket]++;
+      ready_wait_hist[bucket]++;
+    }
+  if (prev != NULL)
+    {
+      cur->switches++;
+      context_switches++;
+    }
+
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
 
@@ -620,7 +931,7 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      thread_page_free (prev);
     }
 }
 
@@ -647,6 +958,54 @@ schedule (void)
   thread_schedule_tail (prev);
 }
 
+/* Returns a page for a new thread, from the thread page cache if
+   possible, or a null pointer if none is available.  Only the
+   struct thread at the start of the page is initialized, by
+   init_thread(), so the page need not be zeroed. */
+static struct thread *
+thread_page_alloc (void)
+{
+  enum intr_level old_level = intr_disable ();
+  void *page = thread_cache;
+
+  if (page != NULL)
+    {
+      thread_cache = *(void **) page;
+      thread_cache_cnt--;
+      thread_cache_hits++;
+    }
+  intr_set_level (old_level);
+
+  if (page == NULL)
+    {
+      page = palloc_get_page (0);
+      thread_cache_misses++;
+    }
+  return page;
+}
+
+/* Releases T's page, keeping it in the thread page cache unless
+   the cache already holds thread_cache_max pages. */
+static void
+thread_page_free (struct thread *t)
+{
+  void *page = t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_cache_cnt >= thread_cache_max)
+    {
+      palloc_free_page (page);
+      return;
+    }
+#ifndef NDEBUG
+  memset (page, 0xcc, PGSIZE);
+#endif
+  *(void **) page = thread_cache;
+  thread_cache = page;
+  thread_cache_cnt++;
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void)
@@ -671,83 +1030,146 @@ uint32_t thread_stack_ofs = offsetof (struct thread, stack);
   i.e timer_ticks()%TIMER_FREQ == 0.
 
   load_avg = (59/60)*load_avg + (1/60)*ready_threads
-
-  This method has no effect if the mlfqs scheduler is not enabled.
 */
-void
-compute_load_avg (void)
-{
-  if(thread_mlfqs == false)
-    return;
-
-  int old_load_avg = load_avg;
-  int first_part = (((int64_t) FP_59_BY_60) * old_load_avg) / F;
-  int ready_threads = list_size(&ready_list) + (thread_current() == idle_thread ? 0 : 1); // Ignore the idle thread
-  int second_part = FP_1_BY_60 * ready_threads;
-  // printf("[compute_load_avg] ticks = %d, first_part = %d, second_part = %d\n", timer_ticks(), first_part, second_part);
-  load_avg = first_part + second_part;
-}
-
 static void
-compute_recent_cpu(struct thread* t, void *aux)
+compute_load_avg (void)
 {
   ASSERT(thread_mlfqs);
 
-  int *co_eff = aux;
-  int co_efficient = *co_eff;
-  int old_cpu = t->recent_cpu;
-  int first_part = (((int64_t) co_efficient) * old_cpu) / F;
-  int second_part = (t->nice)*F;
-  t->recent_cpu = first_part + second_part;
+  int ready_threads = ready_cnt + (thread_current() == idle_thread ? 0 : 1); // Ignore the idle thread
+  load_avg = fp_mul (FP_59_BY_60, load_avg) + FP_1_BY_60 * ready_threads;
 }
 
 /*
-  Computes the recent_cpu of all the threads in the all_list. This method will be called from
-  the interrupt handler i.e timer_interrupt(). It will be updated once every second.
-  i.e timer_ticks()%TIMER_FREQ == 0.
+  Brings T's recent_cpu up to date with every once-per-second decay that has happened since
+  it was last updated, applying
 
   recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice
 
-  This method has no effect if the mlfqs scheduler is not enabled.
+  once per missed second with the coefficient recorded for that second.  A thread only misses
+  more than DECAY_HISTORY seconds if there are so many threads that decay_recent_cpu_batch()
+  could not visit it in that time; the oldest remembered coefficient stands in for the
+  forgotten ones.  Returns true if recent_cpu changed.  Interrupts must be off.
 */
-void
-compute_recent_cpu_for_all_threads (void)
+static bool
+compute_recent_cpu (struct thread *t)
 {
-  if(thread_mlfqs == false)
-    return;
+  ASSERT(thread_mlfqs);
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  int FP_2_MUL_LOAD_AVG = load_avg * 2;
-  int co_efficient = (((int64_t) FP_2_MUL_LOAD_AVG) * F) / (FP_2_MUL_LOAD_AVG + F);
-  thread_foreach(compute_recent_cpu, &co_efficient);
+  if (t->decay_epoch == decay_epoch)
+    return false;
+
+  while (t->decay_epoch != decay_epoch)
+  {
+    int missed = decay_epoch - t->decay_epoch;
+    int epoch = missed > DECAY_HISTORY ? decay_epoch - DECAY_HISTORY + 1 : t->decay_epoch + 1;
+    int co_efficient = decay_coefficients[epoch % DECAY_HISTORY];
+    t->recent_cpu = fp_mul (co_efficient, t->recent_cpu) + fp_from_int (t->nice);
+    t->decay_epoch++;
+  }
+  return true;
 }
 
 /*
   priority = PRI_MAX - (recent_cpu / 4) - (nice * 2)
 */
 static void
-compute_priority_for_mlfqs(struct thread* t, void* aux UNUSED)
+compute_priority_for_mlfqs (struct thread* t)
 {
   ASSERT(thread_mlfqs);
 
-  int FP_priority = (PRI_MAX * F) - (t->recent_cpu / 4) - (t->nice * 2 * F);
-  t->priority = FP_priority / F;
+  int FP_priority = fp_from_int (PRI_MAX - t->nice * 2) - fp_div_pow2 (t->recent_cpu, 2);
+  int priority = fp_to_int (FP_priority);
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  thread_change_priority (t, priority);
 }
 
 /*
-  Computes the priority of all the threads in the all_list. This method will be called from
-  the interrupt handler i.e timer_interrupt(). It will be updated once every fourth clock tick.
-  i.e timer_ticks() % 4 == 0.
+  Starts a new once-per-second recent_cpu decay.  Rather than decaying every thread in all_list
+  here, the coefficient for this second is recorded and the threads are brought up to date a
+  few at a time by decay_recent_cpu_batch(), or on demand by compute_recent_cpu().
+*/
+static void
+start_recent_cpu_decay (void)
+{
+  int FP_2_MUL_LOAD_AVG = load_avg * 2;
+  int co_efficient = fp_div (FP_2_MUL_LOAD_AVG, FP_2_MUL_LOAD_AVG + F);
 
-  priority = PRI_MAX - (recent_cpu / 4) - (nice * 2)
+  decay_epoch++;
+  decay_coefficients[decay_epoch % DECAY_HISTORY] = co_efficient;
+  decay_cursor = list_begin (&all_list);
+}
+
+/*
+  Applies the pending decay to at most DECAY_BATCH threads of all_list, recomputing the priority
+  of each one whose recent_cpu changed.  Bounds the work done per timer interrupt regardless of
+  the number of threads.  Returns true if any priority was recomputed.
+*/
+static bool
+decay_recent_cpu_batch (void)
+{
+  bool changed = false;
+  int n;
+
+  for (n = 0; n < DECAY_BATCH && decay_cursor != list_end (&all_list); n++)
+  {
+    struct thread *t = list_entry (decay_cursor, struct thread, allelem);
+    decay_cursor = list_next (decay_cursor);
+    if (compute_recent_cpu (t))
+    {
+      compute_priority_for_mlfqs (t);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+/*
+  Updates the multi-level feedback queue scheduler state at timer tick TICKS.  Called from the
+  timer interrupt handler.
+
+  For each tick, recent_cpu is incremented by 1 for the running thread, so it is the only thread
+  whose priority needs recomputing every fourth tick.  Once per second load_avg is updated and
+  a recent_cpu decay of all threads is started, which is then carried out in bounded batches on
+  the following ticks.  Interrupt-off time is therefore independent of the number of threads.
 
   This method has no effect if the mlfqs scheduler is not enabled.
 */
 void
-compute_priority_for_all_threads (void)
+thread_mlfqs_tick (int64_t ticks)
 {
+  struct thread *t = thread_current ();
+  bool changed;
+
   if(thread_mlfqs == false)
     return;
 
-  thread_foreach(compute_priority_for_mlfqs, NULL);
-  yield_if_necessary();
+  if (t != idle_thread)
+  {
+    compute_recent_cpu (t);
+    t->recent_cpu = t->recent_cpu + fp_from_int (1);
+  }
+
+  if (ticks % TIMER_FREQ == 0)
+  {
+    start_recent_cpu_decay ();
+    compute_load_avg ();
+    if (compute_recent_cpu (t))
+      compute_priority_for_mlfqs (t);
+  }
+
+  changed = decay_recent_cpu_batch ();
+
+  if (ticks % 4 == 0 && t != idle_thread)
+  {
+    compute_priority_for_mlfqs (t);
+    changed = true;
+  }
+
+  if (changed)
+    yield_if_necessary ();
 }
@@ -2,6 +2,7 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
 #include <stdint.h>
 
@@ -24,11 +25,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
-/* Floating point arithmetic*/
-#define F 16384 // 2^14
-#define F_BY_2 8192 // F/2
-#define FP_59_BY_60 16111 // Floating point arithetic value for 59/60
-#define FP_1_BY_60 273 // Floating point arithetic value for 1/60
+/* Number of buckets in a thread's ready-wait histogram.  Bucket 0
+   counts waits of 0 ticks, bucket B > 0 counts waits of 2**(B-1)
+   through 2**B - 1 ticks, and the last bucket also takes
+   everything longer. */
+#define WAIT_HIST_BUCKETS 16
 
 /* A kernel thread or user process.
 
@@ -80,12 +81,12 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in the run queue (thread.c).
+   A blocked thread is instead in a priority-ordered wait queue
+   (synch.c), through `waitelem' for a semaphore or through an
+   element on its stack for a condition variable.  `wait_queue'
+   and `wait_queue_elem' record which, so that the queue can be
+   reordered when the thread's priority changes by donation. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -97,7 +98,10 @@ struct thread
     struct list_elem allelem;           /* List element for all threads list. */
 
     /* Shared between thread.c and synch.c. */
-    struct list_elem elem;              /* List element. */
+    struct list_elem elem;              /* Run queue element. */
+    struct heap_elem waitelem;          /* Semaphore wait queue element. */
+    struct heap *wait_queue;            /* Queue blocked in, or null. */
+    struct heap_elem *wait_queue_elem;  /* Element in wait_queue. */
 
     /*
       recent_cpu measures how much CPU time each process has received "recently."
@@ -109,16 +113,30 @@ struct thread
           recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice
      */
     int recent_cpu;
+    int decay_epoch;                    /* Last recent_cpu decay applied. */
 
     int nice;
 
     bool priority_donation; //flag to indicate if this thread has a donated priority
-    int priority_before_donation; // This is meaningful only if priority_donation = true;
+    int priority_before_donation; // priority set by thread_set_priority(), before any donation
 
     struct list acquired_locks; // list of locks currently being held by this thread
 
     struct lock *waiting_lock; //the reference to the lock on which the current thread is waiting
 
+    /* Scheduler statistics, owned by thread.c. */
+    int64_t state_since;                /* Tick of last status change. */
+    unsigned switches;                  /* # of times scheduled in. */
+    int64_t run_ticks;                  /* Ticks spent running. */
+    int64_t ready_ticks;                /* Ticks spent ready to run. */
+    int64_t blocked_ticks;              /* Ticks spent blocked. */
+    unsigned wait_hist[WAIT_HIST_BUCKETS]; /* Ready-wait histogram. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wake_tick;                  /* Tick to wake up at. */
+    struct thread *sleep_child;         /* Sleep queue: leftmost child. */
+    struct thread *sleep_sibling;       /* Sleep queue: next sibling. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
@@ -133,11 +151,29 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* How long a thread may run before thread_tick() preempts it. */
+enum thread_slice_policy
+  {
+    SLICE_FIXED,                /* TIME_SLICE ticks for every thread. */
+    SLICE_ADAPTIVE              /* Longer for lower priority bands. */
+  };
+
+/* Controlled by kernel command-line option "-slice=POLICY". */
+extern enum thread_slice_policy thread_slice_policy;
+
+/* Maximum number of free thread pages kept for reuse.
+   Controlled by kernel command-line option "-tcache=COUNT". */
+extern size_t thread_cache_max;
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_tick_idle (int64_t n);
 void thread_print_stats (void);
+void thread_print_sched_stats (void);
+const char *thread_slice_policy_name (void);
+long long thread_context_switches (void);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
@@ -158,14 +194,13 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_change_priority (struct thread *, int priority);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
-void compute_load_avg (void);
-void compute_recent_cpu_for_all_threads (void);
-void compute_priority_for_all_threads (void);
+void thread_mlfqs_tick (int64_t ticks);
 
 #endif /* threads/thread.h */
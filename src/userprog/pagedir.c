@@ -6,11 +6,34 @@
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
+/* A walk over the PTEs for a run of consecutive user pages,
+   one page table at a time.  See pte_range_next(). */
+struct pte_range
+  {
+    uint32_t *pd;               /* Page directory. */
+    uint8_t *upage;             /* First page of current chunk. */
+    size_t page_cnt;            /* Pages left, including current chunk. */
+    uint32_t *pte;              /* PTE for UPAGE. */
+    size_t pte_cnt;             /* Number of PTEs in current chunk. */
+  };
+
+/* Above this many pages, flushing the whole TLB is cheaper than
+   invalidating the pages one by one. */
+#define INVLPG_MAX 32
+
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static uint32_t *lookup_pt (uint32_t *pd, const void *vaddr, bool create);
+static void pte_range_init (struct pte_range *, uint32_t *pd,
+                            void *upage, size_t page_cnt);
+static bool pte_range_next (struct pte_range *, bool create);
+static void invalidate_page (uint32_t *, const void *vpage);
+static void invalidate_range (uint32_t *, const void *upage,
+                              size_t page_cnt);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
+   Kernel RAM mapped with 4 MB pages stays that way, since the
+   PDEs are copied as is.
    Returns the new page directory, or a null pointer if memory
    allocation fails. */
 uint32_t *
@@ -27,34 +50,36 @@ pagedir_create (void)
 void
 pagedir_destroy (uint32_t *pd) 
 {
-  uint32_t *pde;
+  struct pte_range r;
 
   if (pd == NULL)
     return;
 
   ASSERT (pd != init_page_dir);
-  for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
-      {
-        uint32_t *pt = pde_get_pt (*pde);
-        uint32_t *pte;
-        
-        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
-        palloc_free_page (pt);
-      }
+
+  /* Each chunk of the walk is a whole page table, which we free
+     once we have freed the pages it maps. */
+  pte_range_init (&r, pd, NULL, (uintptr_t) PHYS_BASE / PGSIZE);
+  while (pte_range_next (&r, false))
+    {
+      size_t i;
+
+      for (i = 0; i < r.pte_cnt; i++)
+        if (r.pte[i] & PTE_P) 
+          palloc_free_page (pte_get_page (r.pte[i]));
+      palloc_free_page (pg_round_down (r.pte));
+    }
   palloc_free_page (pd);
 }
 
-/* Returns the address of the page table entry for virtual
-   address VADDR in page directory PD.
+/* Returns the page table that covers virtual address VADDR in
+   page directory PD.
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
-   created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   created and returned.  Otherwise, a null pointer is
+   returned. */
 static uint32_t *
-lookup_page (uint32_t *pd, const void *vaddr, bool create)
+lookup_pt (uint32_t *pd, const void *vaddr, bool create)
 {
   uint32_t *pt, *pde;
 
@@ -80,9 +105,78 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
-  /* Return the page table entry. */
-  pt = pde_get_pt (*pde);
-  return &pt[pt_no (vaddr)];
+  /* A 4 MB kernel page has no page table. */
+  if (*pde & PTE_PS)
+    return NULL;
+
+  return pde_get_pt (*pde);
+}
+
+/* Returns the address of the page table entry for virtual
+   address VADDR in page directory PD.
+   If PD does not have a page table for VADDR, behavior depends
+   on CREATE.  If CREATE is true, then a new page table is
+   created and a pointer into it is returned.  Otherwise, a null
+   pointer is returned. */
+static uint32_t *
+lookup_page (uint32_t *pd, const void *vaddr, bool create)
+{
+  uint32_t *pt = lookup_pt (pd, vaddr, create);
+  return pt != NULL ? &pt[pt_no (vaddr)] : NULL;
+}
+
+/* Starts R on a walk over the PTEs for the PAGE_CNT user pages
+   starting at UPAGE in PD. */
+static void
+pte_range_init (struct pte_range *r, uint32_t *pd,
+                void *upage, size_t page_cnt) 
+{
+  ASSERT (pd != NULL);
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (page_cnt <= ((uintptr_t) PHYS_BASE - (uintptr_t) upage) / PGSIZE);
+
+  r->pd = pd;
+  r->upage = upage;
+  r->page_cnt = page_cnt;
+  r->pte = NULL;
+  r->pte_cnt = 0;
+}
+
+/* Advances R past its current chunk to the next run of PTEs that
+   share a page table: sets R->upage to the run's first page,
+   R->pte to its PTE, and R->pte_cnt to the run's length.
+   Missing page tables are created if CREATE is true; otherwise
+   the pages they would cover are skipped.
+   Returns true if there is a next run, false at the end of the
+   range or if creating a page table fails, in which case
+   R->page_cnt is nonzero. */
+static bool
+pte_range_next (struct pte_range *r, bool create) 
+{
+  r->upage += r->pte_cnt * PGSIZE;
+  r->page_cnt -= r->pte_cnt;
+  r->pte_cnt = 0;
+  while (r->page_cnt > 0) 
+    {
+      uint32_t *pt = lookup_pt (r->pd, r->upage, create);
+      size_t idx = pt_no (r->upage);
+      size_t cnt = PGSIZE / sizeof *pt - idx;
+      if (cnt > r->page_cnt)
+        cnt = r->page_cnt;
+
+      if (pt != NULL) 
+        {
+          r->pte = pt + idx;
+          r->pte_cnt = cnt;
+          return true;
+        }
+      else if (create)
+        return false;
+
+      r->upage += cnt * PGSIZE;
+      r->page_cnt -= cnt;
+    }
+  return false;
 }
 
 /* Adds a mapping in page directory PD from user virtual page
@@ -118,6 +212,53 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     return false;
 }
 
+/* Adds mappings in page directory PD from the PAGE_CNT user
+   virtual pages starting at UPAGE to the physical frames
+   identified by the kernel virtual addresses in KPAGES[], in one
+   pass over the page tables.
+   None of the user pages may already be mapped.
+   If WRITABLE is true, the new pages are read/write;
+   otherwise they are read-only.
+   Returns true if successful, false if a user page was already
+   mapped or memory allocation failed, in which case PD is left
+   without any of the new mappings. */
+bool
+pagedir_set_range (uint32_t *pd, void *upage, void **kpages,
+                   size_t page_cnt, bool writable) 
+{
+  struct pte_range r;
+  size_t done, i;
+
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+
+  /* Make sure the whole range is free. */
+  pte_range_init (&r, pd, upage, page_cnt);
+  while (pte_range_next (&r, false))
+    for (i = 0; i < r.pte_cnt; i++)
+      if (r.pte[i] & PTE_P)
+        return false;
+
+  /* Map it. */
+  done = 0;
+  pte_range_init (&r, pd, upage, page_cnt);
+  while (pte_range_next (&r, true))
+    for (i = 0; i < r.pte_cnt; i++, done++) 
+      {
+        ASSERT (pg_ofs (kpages[done]) == 0);
+        ASSERT (vtop (kpages[done]) >> PTSHIFT < init_ram_pages);
+        r.pte[i] = pte_create_user (kpages[done], writable);
+      }
+  if (done == page_cnt)
+    return true;
+
+  /* Out of memory for page tables: take back what we mapped. */
+  pte_range_init (&r, pd, upage, done);
+  while (pte_range_next (&r, false))
+    memset (r.pte, 0, r.pte_cnt * sizeof *r.pte);
+  return false;
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -152,10 +293,54 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+   present" in page directory PD, like pagedir_clear_page() but in
+   one pass over the page tables.
+   The pages need not be mapped. */
+void
+pagedir_clear_range (uint32_t *pd, void *upage, size_t page_cnt) 
+{
+  struct pte_range r;
+  size_t i;
+
+  ASSERT (is_user_vaddr (upage));
+
+  pte_range_init (&r, pd, upage, page_cnt);
+  while (pte_range_next (&r, false))
+    for (i = 0; i < r.pte_cnt; i++)
+      r.pte[i] &= ~(uint32_t) PTE_P;
+  invalidate_range (pd, upage, page_cnt);
+}
+
+/* Makes the mapped pages among the PAGE_CNT user virtual pages
+   starting at UPAGE in page directory PD read/write if WRITABLE
+   is true, read-only otherwise. */
+void
+pagedir_protect_range (uint32_t *pd, void *upage, size_t page_cnt,
+                       bool writable) 
+{
+  struct pte_range r;
+  size_t i;
+
+  ASSERT (is_user_vaddr (upage));
+
+  pte_range_init (&r, pd, upage, page_cnt);
+  while (pte_range_next (&r, false))
+    for (i = 0; i < r.pte_cnt; i++)
+      if (r.pte[i] & PTE_P) 
+        {
+          if (writable)
+            r.pte[i] |= PTE_W;
+          else
+            r.pte[i] &= ~(uint32_t) PTE_W;
+        }
+  invalidate_range (pd, upage, page_cnt);
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -180,7 +365,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,7 +394,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -245,19 +430,43 @@ active_pd (void)
 
 /* Seom page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry for the page that changed.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry for VPAGE if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  Reloading CR3 would also work, but it throws away
+   every other user translation too.  Kernel translations are
+   global, if the CPU supports it, and survive either way.  See
+   [IA32-v3a] 3.12 "Translation Lookaside Buffers (TLBs)" and
+   [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vpage) 
 {
-  if (active_pd () == pd) 
+  if (active_pd () == pd)
+    asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+}
+
+/* Invalidates the TLB entries for the PAGE_CNT pages starting at
+   UPAGE, if PD is the active page directory.  Large ranges are
+   handled by re-activating PD, which flushes all the user
+   translations at once; kernel translations are global and
+   survive it. */
+static void
+invalidate_range (uint32_t *pd, const void *upage, size_t page_cnt) 
+{
+  if (active_pd () != pd)
+    return;
+
+  if (page_cnt <= INVLPG_MAX) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      const uint8_t *p = upage;
+      size_t i;
+
+      for (i = 0; i < page_cnt; i++, p += PGSIZE)
+        invalidate_page (pd, p);
+    }
+  else
+    pagedir_activate (pd);
 }
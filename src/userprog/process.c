@@ -494,7 +494,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
+static bool install_pages (void *upage, void **kpages, size_t page_cnt,
+                           bool writable);
+
+/* Maximum number of pages that load_segment() maps at once. */
+#define LOAD_BATCH 32
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -566,36 +570,52 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
-      if (kpage == NULL)
-        return false;
-
-      /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
+      void *kpages[LOAD_BATCH];
+      size_t page_cnt = 0;
+      bool success = true;
+      size_t i;
+
+      /* Load up to LOAD_BATCH pages. */
+      while (page_cnt < LOAD_BATCH && (read_bytes > 0 || zero_bytes > 0))
         {
-          palloc_free_page (kpage);
-          return false; 
+          /* Calculate how to fill this page.
+             We will read PAGE_READ_BYTES bytes from FILE
+             and zero the final PAGE_ZERO_BYTES bytes. */
+          size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
+          size_t page_zero_bytes = PGSIZE - page_read_bytes;
+
+          /* Get a page of memory. */
+          uint8_t *kpage = palloc_get_page (PAL_USER);
+          if (kpage == NULL)
+            {
+              success = false;
+              break;
+            }
+          kpages[page_cnt++] = kpage;
+
+          /* Load this page. */
+          if (file_read (file, kpage, page_read_bytes)
+              != (int) page_read_bytes)
+            {
+              success = false;
+              break;
+            }
+          memset (kpage + page_read_bytes, 0, page_zero_bytes);
+
+          read_bytes -= page_read_bytes;
+          zero_bytes -= page_zero_bytes;
         }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
 
-      /* Add the page to the process's address space. */
-      if (!install_page (upage, kpage, writable)) 
+      /* Add the pages to the process's address space. */
+      if (!success || !install_pages (upage, kpages, page_cnt, writable)) 
         {
-          palloc_free_page (kpage);
+          for (i = 0; i < page_cnt; i++)
+            palloc_free_page (kpages[i]);
           return false; 
         }
 
       /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
+      upage += page_cnt * PGSIZE;
     }
   return true;
 }
@@ -605,13 +625,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 static bool
 setup_stack (void **esp) 
 {
-  uint8_t *kpage;
+  void *kpage;
   bool success = false;
 
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
   if (kpage != NULL) 
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
+      success = install_pages (((uint8_t *) PHYS_BASE) - PGSIZE,
+                               &kpage, 1, true);
       if (success)
         *esp = PHYS_BASE;
       else
@@ -620,22 +641,19 @@ setup_stack (void **esp)
   return success;
 }
 
-/* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise, it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
+/* Adds mappings from the PAGE_CNT user virtual pages starting
+   at UPAGE to the kernel virtual addresses in KPAGES[] to the
+   page table.
+   If WRITABLE is true, the user process may modify the pages;
+   otherwise, they are read-only.
+   KPAGES[] should probably hold pages obtained from the user
+   pool with palloc_get_page().
+   Returns true on success, false if any of the user pages is
+   already mapped or if memory allocation fails, in which case
+   none of them are mapped. */
 static bool
-install_page (void *upage, void *kpage, bool writable)
+install_pages (void *upage, void **kpages, size_t page_cnt, bool writable)
 {
   struct thread *t = thread_current ();
-
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable));
+  return pagedir_set_range (t->pagedir, upage, kpages, page_cnt, writable);
 }